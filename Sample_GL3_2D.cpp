@@ -3,6 +3,14 @@
 #include <fstream>
 #include <vector>
 
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -11,240 +19,106 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-using namespace glm;
-
-struct VAO {
-  GLuint VertexArrayID;
-  GLuint VertexBuffer;
-  GLuint ColorBuffer;
+#include "render.h"
+#include "soft_raster.h"
+#include "image_io.h"
+#include "capture.h"
+#include "simulation.h"
+#include "integrate.h"
+#include "jobs.h"
+#include "level.h"
+#include "loader.h"
+#include "input_log.h"
+#include "batch.h"
+#include "solver.h"
+#include "ecs.h"
+#include "pacing.h"
+#include "triple_buffer.h"
+#include "spsc.h"
+#include "profile.h"
+#include "trace.h"
+#include "stress.h"
 
-  GLenum PrimitiveMode;
-  GLenum FillMode;
-  int NumVertices;
-};
-typedef struct VAO VAO;
-
-struct GLMatrices {
-	glm::mat4 projection;
-	glm::mat4 model;
-	glm::mat4 view;
-	GLuint MatrixID;
-} Matrices;
-
-GLuint programID;
-
-/* Function to load Shaders - Use it as it is */
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open())
-	{
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}
-
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
-
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> VertexShaderErrorMessage(InfoLogLength);
-	glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-	fprintf(stdout, "%s\n", &VertexShaderErrorMessage[0]);
-
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> FragmentShaderErrorMessage(InfoLogLength);
-	glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-	fprintf(stdout, "%s\n", &FragmentShaderErrorMessage[0]);
-
-	// Link the program
-	fprintf(stdout, "Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
-
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> ProgramErrorMessage( max(InfoLogLength, int(1)) );
-	glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-	fprintf(stdout, "%s\n", &ProgramErrorMessage[0]);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
-	return ProgramID;
-}
+using namespace glm;
 
 static void error_callback(int error, const char* description)
 {
   fprintf(stderr, "Error: %s\n", description);
 }
 
+// Draws the frames of a window unless --no-render-thread, the GL context
+// is its own from the first frame on
+std::thread render_thread;
+void stopRenderer (GLFWwindow* window);
+
+// Set by Q, the score is spelled out on the way out
+bool announce_score = false;
+// Profile overlay, toggled by F3, and --profile logging
+std::atomic<bool> show_profile(false);
+bool profile_logging = false;
+
+/* On stdout, unless raw frames went there */
+void printScore ()
+{
+  std::ostream& out = capture_uses_stdout() ? std::cerr : std::cout;
+  if (announce_score)
+    out << "Your score is ";
+  out << sim.score << '\n';
+}
+
+/* Once the window should close, after the last frame */
 void quit(GLFWwindow *window)
 {
+  stopRenderer(window);
+  sim_wait();
+  input_record_stop(sim_input_tick());
+  jobs_shutdown();
+  loader_stop();
+  capture_shutdown();
+  profile_shutdown();
+  pacing_report();
   glfwDestroyWindow(window);
   glfwTerminate();
+  printScore();
   exit(EXIT_SUCCESS);
 }
 
 
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
-{
-  struct VAO* vao = new struct VAO;
-  vao->PrimitiveMode = primitive_mode;
-  vao->NumVertices = numVertices;
-  vao->FillMode = fill_mode;
-
-    // Create Vertex Array Object
-    // Should be done after CreateWindow and before any other GL calls
-    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
-
-    glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
-    glVertexAttribPointer(
-                          0,                  // attribute 0. Vertices
-                          3,                  // size (x,y,z)
-                          GL_FLOAT,           // type
-                          GL_FALSE,           // normalized?
-                          0,                  // stride
-                          (void*)0            // array buffer offset
-                          );
-
-    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
-    glVertexAttribPointer(
-                          1,                  // attribute 1. Color
-                          3,                  // size (r,g,b)
-                          GL_FLOAT,           // type
-                          GL_FALSE,           // normalized?
-                          0,                  // stride
-                          (void*)0            // array buffer offset
-                          );
-
-    return vao;
-  }
-
-/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-  struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
-  {
-    GLfloat* color_buffer_data = new GLfloat [3*numVertices];
-    for (int i=0; i<numVertices; i++) {
-      color_buffer_data [3*i] = red;
-      color_buffer_data [3*i + 1] = green;
-      color_buffer_data [3*i + 2] = blue;
-    }
-
-    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
-  }
-
-/* Render the VBOs handled by VAO */
-  void draw3DObject (struct VAO* vao)
-  {
-    // Change the Fill Mode for this object
-    glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
-
-    // Bind the VAO to use
-    glBindVertexArray (vao->VertexArrayID);
-
-    // Enable Vertex Attribute 0 - 3d Vertices
-    glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
-
-    // Enable Vertex Attribute 1 - Color
-    glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
-
-    // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
-  }
-
 /**************************
  * Customizable functions *
  **************************/
 
- float cannon_rot_dir = 1;
- bool cannon_rot_status = false;
- bool flag = false;
- bool shot = false;
- float speed=.03;
- float delta_t = 0;
- float gravity = -.01;
  float camera_rotation_angle = 90;
- float cannon_rotation = 0;
- float ballx_initial = 0;
- float bally_initial = 1;
- float speedx_initial = 0;
- float speedy_initial = 0;
- float speedy_final = 0;
- float radius = 0.1;
- float yoffset = 1.06;
- float xoffset = 3.1;
- bool flg[3] = {false};
- int score = 0;
-
-/* Executed when a regular key is pressed/released/held-down */
-/* Prefered for Keyboard events */
- void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
- {
-     // Function is called first on GLFW_PRESS.
 
+/* Key presses and releases that steer the game, from the keyboard or a
+   replay, right before the step of 'tick'. Recorded with that tick. */
+void applyKey (unsigned long tick, int key, int action)
+{
+  input_record(tick, action == GLFW_PRESS ? INPUT_PRESS : INPUT_RELEASE, key);
   if (action == GLFW_RELEASE) {
     switch (key) {
       case GLFW_KEY_C:
-      cannon_rot_status = false;
+      controls.rotating = false;
       break;
       case GLFW_KEY_P:
-      cannon_rot_status = false;
+      controls.rotating = false;
       break;
       case GLFW_KEY_F:
-      speed += .01;
+      controls.speed += 1;
       break;
       case GLFW_KEY_S:
-      speed -= .01;
+      controls.speed -= 1;
       break;
       case GLFW_KEY_SPACE:
-      shot = true;
+      controls.fire = true;
+      break;
+      case GLFW_KEY_M:
+      // single shot, then spreads of 3 and 5 balls
+      controls.spread = controls.spread >= 5 ? 1 : controls.spread + 2;
+      break;
+      case GLFW_KEY_B:
+      // single shot, then bursts of 3 and 5 shots
+      controls.burst = controls.burst >= 5 ? 1 : controls.burst + 2;
       break;
       // case GLFW_KEY_Z:
       // zoom += .5;
@@ -256,18 +130,15 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
       break;
     }
   }
-  else if (action == GLFW_PRESS) {
+  else {
     switch (key) {
       case GLFW_KEY_C:
-      cannon_rot_status = true;
-      cannon_rot_dir = 1;
+      controls.rotating = true;
+      controls.rotate_dir = 1;
       break;
       case GLFW_KEY_P:
-      cannon_rot_status = true;
-      cannon_rot_dir = -1;
-      break;
-      case GLFW_KEY_ESCAPE:
-      quit(window);
+      controls.rotating = true;
+      controls.rotate_dir = -1;
       break;
       default:
       break;
@@ -275,14 +146,56 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
   }
 }
 
+/* Keys from the callbacks, stamped with the time they came in. The
+   callbacks only push, the steps pop what is due before each of them, so
+   'controls' only ever changes between steps on the thread running them. */
+struct KeyEvent {
+  double time;    // glfwGetTime()
+  int key;
+  int action;
+};
+SpscRing<KeyEvent> key_events(256);
+
+/* Input drain of the simulation: every key that came in by 'until' goes
+   into the step of 'tick' */
+void drainKeys (unsigned long tick, double until)
+{
+  KeyEvent e;
+  while (key_events.peek(e) && e.time <= until) {
+    key_events.pop(e);
+    applyKey(tick, e.key, e.action);
+  }
+}
+
+/* Executed when a regular key is pressed/released/held-down */
+/* Prefered for Keyboard events */
+ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
+ {
+     // Function is called first on GLFW_PRESS.
+
+  if (action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
+    glfwSetWindowShouldClose(window, GL_TRUE);
+  else if (action == GLFW_PRESS && key == GLFW_KEY_F4)
+    trace_request_toggle();
+  else if (action == GLFW_PRESS && key == GLFW_KEY_F3) {
+    show_profile = !show_profile;
+    profile_enable(show_profile || profile_logging);
+  }
+  else if (action == GLFW_PRESS || action == GLFW_RELEASE) {
+    // A full queue means the steps are stuck, the key is dropped
+    KeyEvent e = { glfwGetTime(), key, action };
+    key_events.push(e);
+  }
+}
+
 /* Executed for character input (like in text boxes) */
 void keyboardChar (GLFWwindow* window, unsigned int key)
 {
  switch (key) {
   case 'Q':
   case 'q':
-  std::cout << "Your score is " << score << '\n';
-  quit(window);
+  announce_score = true;
+  glfwSetWindowShouldClose(window, GL_TRUE);
   break;
   default:
   break;
@@ -308,19 +221,16 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 }
 
 
-/* Executed when window is resized to 'width' and 'height' */
+/* Viewport and projection for a framebuffer of 'fbwidth' by 'fbheight',
+   on the thread that owns the GL context */
 /* Modify the bounds of the screen here in glm::ortho or Field of View in glm::Perspective */
-void reshapeWindow (GLFWwindow* window, int width, int height)
+void resizeFrame (int fbwidth, int fbheight)
 {
-  int fbwidth=width, fbheight=height;
-    /* With Retina display on Mac OS X, GLFW's FramebufferSize
-     is different from WindowSize */
-  glfwGetFramebufferSize(window, &fbwidth, &fbheight);
-
   GLfloat fov = 90.0f;
 
 	// sets the viewport of openGL renderer
-  glViewport (0, 0, (GLsizei) fbwidth, (GLsizei) fbheight);
+  setViewport (fbwidth, fbheight);
+  capture_resize (fbwidth, fbheight);
 
 	// set the projection matrix as perspective
 	/* glMatrixMode (GL_PROJECTION);
@@ -334,35 +244,59 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
      // Matrices.projection = glm::ortho(-4.0f * ((float)width/(float)height), 4.0f * ((float)width/(float)height), -4.0f, 4.0f, 0.1f, 500.0f);
    }
 
-   VAO *triangle, *rectangle, *cannon, *pivot, *ball, *t_ball1, *t_ball2, *t_ball3, *t_rectangle, *t_triangle, *t_trep, *blueball;
+// Size of the framebuffer, the render thread gets it with every frame
+int framebuffer_width, framebuffer_height;
 
-// Creates the triangle object used in this sample code
- // triangle
-   void createTriangle ()
-   {
-    static const GLfloat vertex_buffer_data [] = {
-    2, -3,0, // vertex 0
-    3,-3,0, // vertex 1
-    2.5,-2,0, // vertex 2
-  };
+/* Executed when window is resized to 'width' and 'height' */
+void reshapeWindow (GLFWwindow* window, int width, int height)
+{
+  int fbwidth=width, fbheight=height;
+    /* With Retina display on Mac OS X, GLFW's FramebufferSize
+     is different from WindowSize */
+  if (window)
+    glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+  framebuffer_width = fbwidth;
+  framebuffer_height = fbheight;
+  if (!render_thread.joinable())
+    resizeFrame(fbwidth, fbheight);
+}
 
-  static const GLfloat color_buffer_data [] = {
-    .2,.2,.2, // color 0
-    .2,.2,.2, // color 1
-    .2,.2,.2, // color 2
-  };
+// Every ball in flight is drawn with this
+VAO* ball;
+
+// Bars of the profile overlay: a row per section from the top left, the
+// average CPU time as a long bar with the GPU time under it and a tick at
+// the 99th percentile, a level unit per millisecond
+enum { BAR_CPU, BAR_GPU, BAR_P99, BARS };
+VAO* profile_bars[BARS];
 
-  triangle = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
+VAO* create_bar (float r, float g, float b)
+{
+  static const GLfloat square[] = {
+    0,0,0, 1,0,0, 1,1,0,
+    0,0,0, 1,1,0, 0,1,0
+  };
+  return create3DObject(GL_TRIANGLES, 6, square, r, g, b, GL_FILL);
 }
 
-// pivot
-void create_pivot ()
+// Everything else on screen, and the colliders
+World scene;
+// Parts of the cannon in draw order, and the joint they turn about
+enum { CANNON_BARREL, CANNON_BLUEBALL, CANNON_PIVOT, CANNON_BALL, CANNON_MOUNT, CANNON_PARTS };
+Entity cannon[CANNON_PARTS];
+// Per obstacle mesh chunk and per target of the level
+std::vector<Entity> obstacle_chunks;
+std::vector<Entity> target_entities;
+
+// pivot, drawn moved up by (1, .8)
+static const GLfloat pivot_vertices [] = {
+  0, -0.4, 0,
+  -0.2, -.8, 0,
+  0.2, -.8, 0
+};
+
+VAO* create_pivot ()
 {
-  static const GLfloat vertex_buffer_data [] = {
-   0, -0.4, 0,
-   -0.2, -.8, 0,
-   0.2, -.8, 0
- };
 
  static const GLfloat color_buffer_data [] = {
   1.0, 0.0, 0.0,
@@ -370,39 +304,11 @@ void create_pivot ()
   1.0, 0.0, 0.0
 };
 
-pivot = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-
-// rectangle
-void createRectangle()
-{
-  // GL3 accepts only Triangles. Quads are not supported static
-  static const GLfloat vertex_buffer_data [] = {
-    -1.2,-1,0, // vertex 1
-    1.2,-1,0, // vertex 2
-    1.2, 1,0, // vertex 3
-
-    1.2, 1,0, // vertex 3
-    -1.2, 1,0, // vertex 4
-    -1.2,-1,0  // vertex 1
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    1,0,0, // color 1
-    0,0,1, // color 2
-    0,1,0, // color 3
-
-    0,1,0, // color 3
-    0.3,0.3,0.3, // color 4
-    1,0,0  // color 1
-  };
-
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  rectangle = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+return create3DObject(GL_TRIANGLES, 3, pivot_vertices, color_buffer_data, GL_FILL);
 }
 
 // cannon
-void create_cannon()
+VAO* create_cannon()
 {
   static const GLfloat vertex_buffer_data [] = {
     .1, 0.5,  0,
@@ -424,10 +330,10 @@ void create_cannon()
     0.0, 0.0, 1.0,
   };
 
-  cannon = create3DObject(GL_TRIANGLES, 9, vertex_buffer_data, color_buffer_data, GL_FILL);
+  return create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
-void create_blueball()
+VAO* create_blueball()
 {
   GLfloat  PI = 3.141592654;
   GLfloat angle = 0.0;
@@ -447,12 +353,11 @@ void create_blueball()
     color_buffer_data[i++] = 0;
     color_buffer_data[i++] = 1;
   }
-  blueball = create3DObject(GL_TRIANGLE_FAN, points, vertex_buffer_data, color_buffer_data, GL_FILL);
-
+  return create3DObject(GL_TRIANGLE_FAN, points, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
 // ball
-void create_ball()
+VAO* create_ball()
 {
   GLfloat  PI = 3.141592654;
   GLfloat angle = 0.0;
@@ -462,8 +367,8 @@ void create_ball()
   /* code for circle*/
   for(int i = 0; i < 3*points;){
     angle = PI * i / points;
-    vertex_buffer_data[i++] = radius*(float)cos(angle);
-    vertex_buffer_data[i++] = radius*(float)sin(angle);
+    vertex_buffer_data[i++] = BALL_RADIUS*(float)cos(angle);
+    vertex_buffer_data[i++] = BALL_RADIUS*(float)sin(angle);
     vertex_buffer_data[i++] = 0;
   }
   /* code for circle*/
@@ -472,159 +377,219 @@ void create_ball()
     color_buffer_data[i++] = 1;
     color_buffer_data[i++] = 0;
   }
-  ball = create3DObject(GL_TRIANGLE_FAN, points, vertex_buffer_data, color_buffer_data, GL_FILL);
+  return create3DObject(GL_TRIANGLE_FAN, points, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
-// target balls
-void target_ball1()
+// Level loaded at startup, its arrays are used in place
+Level level;
+const char* level_path = "levels/default.lvl";
+
+/* --stress: a generated scene instead of the level file */
+struct StressScene {
+  bool on;
+  int targets, obstacles, balls;
+  unsigned int seed;
+} stress = { false, 0, 0, 0, 1 };
+
+/* Uploads finished level meshes until 'budget' bytes went to the GPU this
+   frame, at least one mesh. True once the whole level is uploaded. */
+bool uploadLevel (size_t budget)
 {
-  GLfloat  PI = 3.141592654;
-  GLfloat angle = 0.0;
-  int points = 100;
-  static GLfloat vertex_buffer_data[300];
-  static GLfloat color_buffer_data[300];
-  /* code for circle*/
-  for(int i = 0; i < 3*points;){
-    angle = PI * i / points;
-    vertex_buffer_data[i++] = .5*(float)cos(angle);
-    vertex_buffer_data[i++] = .5*(float)sin(angle);
-    vertex_buffer_data[i++] = 0;
-  }
-  /* code for circle*/
-  for(int i = 0 ; i < 3*points ; ){
-    color_buffer_data[i++] = .6;
-    color_buffer_data[i++] = .56;
-    color_buffer_data[i++] = .21;
+  TraceScope trace("upload level");
+  size_t uploaded = 0;
+  LevelMesh* mesh;
+  while ((uploaded == 0 || uploaded < budget) && (mesh = loader_pop())) {
+    int count = mesh->vertices.size() / 3;
+    if (mesh->kind == MESH_TARGET) {
+      VAO* vao = create3DObject(GL_TRIANGLE_FAN, count, &mesh->vertices[0], &mesh->colors[0], GL_FILL);
+      for (size_t i = 0; i < mesh->targets.size(); i++) {
+        EntityRef r = world_get(scene, target_entities[mesh->targets[i]]);
+        r.a->vao[r.row] = vao;
+      }
+    }
+    else {
+      EntityRef r = world_get(scene, obstacle_chunks[mesh->chunk]);
+      r.a->vao[r.row] = create3DObject(GL_TRIANGLES, count, &mesh->vertices[0], &mesh->colors[0], GL_FILL);
+    }
+    uploaded += mesh->bytes();
+    delete mesh;
   }
-  t_ball1 = create3DObject(GL_TRIANGLE_FAN, points, vertex_buffer_data, color_buffer_data, GL_FILL);
-
+  return loader_done();
 }
 
-void target_ball2()
+/* Entities in draw order: obstacles, the cannon, targets. Their meshes
+   come later, from initGL and the level loader. */
+void createScene ()
 {
-  GLfloat  PI = 3.141592654;
-  GLfloat angle = 0.0;
-  int points = 100;
-  static GLfloat vertex_buffer_data[300];
-  static GLfloat color_buffer_data[300];
-  /* code for circle*/
-  for(int i = 0; i < 3*points;){
-    angle = PI * i / points;
-    vertex_buffer_data[i++] = .7*(float)cos(angle);
-    vertex_buffer_data[i++] = .7*(float)sin(angle);
-    vertex_buffer_data[i++] = 0;
+  world_clear(scene);
+  obstacle_chunks.resize(loader_chunks(level));
+  for (size_t i = 0; i < obstacle_chunks.size(); i++)
+    obstacle_chunks[i] = world_create(scene, COMPONENT_TRANSFORM | COMPONENT_RENDERABLE);
+
+  // The pivot stands at (1, .8), the mount turns below its tip at (1, .3)
+  // and carries the barrel and the blue ball, the barrel carries the ball
+  // at its muzzle
+  for (int i = 0; i < CANNON_PARTS; i++)
+    cannon[i] = world_create(scene, i == CANNON_MOUNT ? COMPONENT_TRANSFORM : COMPONENT_TRANSFORM | COMPONENT_RENDERABLE);
+  transform_set(scene, cannon[CANNON_PIVOT], 1, .8, 0);
+  transform_attach(scene, cannon[CANNON_MOUNT], cannon[CANNON_PIVOT]);
+  transform_set(scene, cannon[CANNON_MOUNT], 0, -.5, 0);
+  transform_attach(scene, cannon[CANNON_BARREL], cannon[CANNON_MOUNT]);
+  transform_set(scene, cannon[CANNON_BARREL], 0, .5, 0);
+  transform_attach(scene, cannon[CANNON_BLUEBALL], cannon[CANNON_MOUNT]);
+  transform_attach(scene, cannon[CANNON_BALL], cannon[CANNON_BARREL]);
+  transform_set(scene, cannon[CANNON_BALL], 0, .36, 0);
+
+  target_entities.resize(level.header->target_count);
+  for (size_t t = 0; t < target_entities.size(); t++) {
+    target_entities[t] = world_create(scene, COMPONENT_TRANSFORM | COMPONENT_RENDERABLE | COMPONENT_TARGET);
+    transform_set(scene, target_entities[t], level.targets[t].x, level.targets[t].y, 0, level.targets[t].radius);
+    EntityRef r = world_get(scene, target_entities[t]);
+    r.a->target[r.row] = t;
   }
-  /* code for circle*/
-  for(int i = 0 ; i < 3*points ; ){
-    color_buffer_data[i++] = .78;
-    color_buffer_data[i++] = .2323;
-    color_buffer_data[i++] = .321;
-  }
-  t_ball2 = create3DObject(GL_TRIANGLE_FAN, points, vertex_buffer_data, color_buffer_data, GL_FILL);
 
+  // The pivot is part of the cannon and collides too
+  for (unsigned int i = 0; i <= level.header->obstacle_count; i++) {
+    EntityRef r = world_get(scene, world_create(scene, COMPONENT_COLLIDER));
+    if (i < level.header->obstacle_count)
+      r.a->collider[r.row] = level.obstacles[i];
+    else
+      polygon_from_vertices(pivot_vertices, 3, 1, .8, r.a->collider[r.row]);
+  }
 }
 
-void target_ball3()
+/* Colliders of the scene into the simulation */
+void updateColliders ()
 {
-  GLfloat  PI = 3.141592654;
-  GLfloat angle = 0.0;
-  int points = 100;
-  static GLfloat vertex_buffer_data[300];
-  static GLfloat color_buffer_data[300];
-  /* code for circle*/
-  for(int i = 0; i < 3*points;){
-    angle = PI * i / points;
-    vertex_buffer_data[i++] = .2*(float)cos(angle);
-    vertex_buffer_data[i++] = .2*(float)sin(angle);
-    vertex_buffer_data[i++] = 0;
-  }
-  /* code for circle*/
-  for(int i = 0 ; i < 3*points ; ){
-    color_buffer_data[i++] = .6231;
-    color_buffer_data[i++] = .42;
-    color_buffer_data[i++] = .6767;
+  std::vector<Polygon> list;
+  for (size_t i = 0; i < scene.archetypes.size(); i++) {
+    const Archetype& a = *scene.archetypes[i];
+    if (a.mask & COMPONENT_COLLIDER)
+      list.insert(list.end(), a.collider.begin(), a.collider.end());
   }
-  t_ball3 = create3DObject(GL_TRIANGLE_FAN, points, vertex_buffer_data, color_buffer_data, GL_FILL);
-
+  sim_set_obstacles(list);
 }
-// target balls
 
-// target rectangle
-void target_rectangle()
+/* Meshes of the cannon, and the level's streaming in */
+void create_level ()
 {
-  static const GLfloat vertex_buffer_data [] = {
-    2,0,0,
-    2.5,0,0, 
-    2.5,3,0,
-
-    2.5,3,0, 
-    2,3,0,
-    2,0,0 
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    .2,.2,.2, // color 1
-    .2,.2,.2, // color 2
-    .2,.2,.2, // color 3
-
-    .2,.2,.2, // color 3
-    0.2,0.2,0.2, // color 4
-    .2,.2,.2  // color 1
-  };
-  t_rectangle = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+  ball = create_ball();
+  profile_bars[BAR_CPU] = create_bar(1, 1, 1);
+  profile_bars[BAR_GPU] = create_bar(1, .8f, 0);
+  profile_bars[BAR_P99] = create_bar(1, 0, 0);
+  VAO* parts[CANNON_MOUNT] = { create_cannon(), create_blueball(), create_pivot(), ball };
+  for (int i = 0; i < CANNON_MOUNT; i++) {
+    EntityRef r = world_get(scene, cannon[i]);
+    r.a->vao[r.row] = parts[i];
+  }
+  loader_start(level);
 }
 
-// target trapezium
-void target_trepezium()
+/* Targets come from the level, the scene from both */
+bool loadLevel ()
 {
-  static const GLfloat vertex_buffer_data [] = {
-    3.7,2,0,
-    4.7,2,0, 
-    4.5,2.5,0,
-
-    4.5,2.5,0, 
-    4.1,2.5,0,
-    3.7,2,0 
-  };
+  if (stress.on ? !stress_level(level, stress.targets, stress.obstacles, stress.seed) : !level_load(level, level_path))
+    return false;
+  sim_set_targets(std::vector<Target>(level.targets, level.targets + level.header->target_count));
+  createScene();
+  updateColliders();
+  return true;
+}
 
-  static const GLfloat color_buffer_data [] = {
-    .4,.4,.4, // color 1
-    .4,.4,.4, // color 2
-    .4,.4,.4, // color 3
+/* Every entity with a mesh, the targets or everything else. Parts of the
+   level not uploaded yet are skipped, MVPs are kept until the camera or
+   the entity moves. */
+void drawEntities (const mat4& VPAxes, bool camera_moved, bool targets)
+{
+  for (size_t i = 0; i < scene.archetypes.size(); i++) {
+    Archetype& a = *scene.archetypes[i];
+    if ((a.mask & (COMPONENT_TRANSFORM | COMPONENT_RENDERABLE)) != (COMPONENT_TRANSFORM | COMPONENT_RENDERABLE))
+      continue;
+    if (targets != ((a.mask & COMPONENT_TARGET) != 0))
+      continue;
+    for (int k = 0; k < a.count; k++) {
+      if (!a.vao[k] || (targets && a.hit[k]))
+        continue;
+      mat4 MVP;
+      if (a.moved[k] || camera_moved) {
+        const float* w = a.world[k].m;
+        mat4 model(1.0f);
+        model[0][0] = w[0];
+        model[0][1] = w[1];
+        model[1][0] = w[2];
+        model[1][1] = w[3];
+        model[3][0] = w[4];
+        model[3][1] = w[5];
+        MVP = VPAxes * model;
+        memcpy(a.mvp[k].m, &MVP[0][0], sizeof(a.mvp[k].m));
+        a.moved[k] = 0;
+      }
+      else
+        memcpy(&MVP[0][0], a.mvp[k].m, sizeof(a.mvp[k].m));
+      setMVP(MVP);
+      draw3DObject(a.vao[k]);
+    }
+  }
+}
 
-    .4,.4,0, // color 3
-    0.4,0.4,0.4, // color 4
-    .4,.4,.4  // color 1
-  };
-  t_trep = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+void drawBar (const mat4& VPAxes, int bar, float x, float y, float width, float height)
+{
+  setMVP(VPAxes * translate(vec3(x, y, .1f)) * scale(vec3(std::min(width, 7.8f - x), height, 1)));
+  draw3DObject(profile_bars[bar]);
 }
 
-// target triangle
-void target_triangle()
+void drawProfile (const mat4& VPAxes)
 {
-  static const GLfloat vertex_buffer_data [] = {
-   7, 0, 0,
-   7.6, 0, 0,
-   7.3, 1, 0
- };
+  for (int s = 0; s < PROFILE_SECTIONS; s++) {
+    float y = 7.7f - .3f * s;
+    ProfileStats stats;
+    if (profile_stats((ProfileSection) s, false, stats)) {
+      drawBar(VPAxes, BAR_CPU, .1f, y, stats.avg, .12f);
+      drawBar(VPAxes, BAR_P99, .1f + stats.p99, y - .02f, .03f, .2f);
+    }
+    if (profile_stats((ProfileSection) s, true, stats))
+      drawBar(VPAxes, BAR_GPU, .1f, y - .1f, stats.avg, .08f);
+  }
+}
 
- static const GLfloat color_buffer_data [] = {
-  .5, .5, .5,
-  .5, .5, .5,
-  .5, .5, .5
-};
-t_triangle = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
+/* Throughput of a --stress run on the drawing thread, after every frame
+   with the tick of the state it showed. Logged every second, and at the
+   'last' frame for runs shorter than that. */
+void stressFrame (unsigned long tick, bool last)
+{
+  static bool started = false;
+  static std::chrono::steady_clock::time_point since;
+  static unsigned long since_tick;
+  static int frames = 0;
+  static long draws = 0, vertices = 0;
+
+  // Counted from the end of the first frame
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (started) {
+    frames++;
+    draws += render_stats.draws;
+    vertices += render_stats.vertices;
+  }
+  render_stats.draws = render_stats.vertices = 0;
+  double seconds = std::chrono::duration<double>(now - since).count();
+  if (started && frames && (seconds >= 1 || last))
+    std::cerr << "stress: " << frames / seconds << " fps, " << (tick - since_tick) / seconds << " steps/s, "
+              << draws / frames << " draws/frame, " << vertices / frames << " vertices/frame\n";
+  else if (started)
+    return;
+  started = true;
+  since = now;
+  since_tick = tick;
+  frames = 0;
+  draws = vertices = 0;
 }
 
 /* Render the scene with openGL */
-/* Edit this function according to your assignment */
-void draw ()
+/* alpha is how far this frame is between the last two physics steps of the view */
+void draw (const SimView& view, float alpha)
 {
-  float a[][3] = {
-    {4.3,3,0.5},{2.25,3.7,0.7},{7.3,1.2,0.2}
-  };
-  glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glUseProgram (programID);
+  clearFrame();
+  useProgram();
   vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
   vec3 target (0, 0, 0);
   vec3 up (0, 1, 1);
@@ -634,161 +599,52 @@ void draw ()
   //  Don't change unless you are sure!!
   Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
 
+  // Interpolate the moving parts between the previous and the current step
+  float cannon_rotation = view.cannon_rotation;
+  if (fabs(view.cannon_rotation - view.prev_rotation) < 90) // not when wrapping around
+    cannon_rotation = view.prev_rotation + (view.cannon_rotation - view.prev_rotation) * alpha;
+
   mat4 VP = Matrices.projection * Matrices.view;
-  mat4 MVP;
   mat4 translateAxes = translate(vec3(-4,-4,0));
-
-  // target triangle
-  Matrices.model = mat4(1.0f);
-  MVP = VP * Matrices.model;
-  MVP *= translateAxes;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(t_triangle);
-
-  // target rectangle
-  Matrices.model = mat4(1.0f);
-  MVP = VP * Matrices.model;
-  MVP *= translateAxes;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(t_rectangle);
-  // draw3DTexturedObject(rectangle);
-
-  // target trapezium
-  Matrices.model = mat4(1.0f);
-  MVP = VP * Matrices.model;
-  MVP *= translateAxes;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(t_trep);
-
-  mat4 translateBall;
-
-  // Target balls
-  Matrices.model = mat4(1.0f);
-  MVP = VP * Matrices.model;
-  MVP *= translateAxes;
-  translateBall = translate(vec3(4.3,3,0));
-  MVP *= translateBall;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  if(!flg[0])
-    draw3DObject(t_ball1);
-
-  Matrices.model = mat4(1.0f);
-  MVP = VP * Matrices.model;
-  MVP *= translateAxes;
-  translateBall = translate(vec3(2.25,3.7,0));
-  MVP *= translateBall;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  if(!flg[1])
-    draw3DObject(t_ball2);
-
-  Matrices.model = mat4(1.0f);
-  MVP = VP * Matrices.model;
-  MVP *= translateAxes;
-  translateBall = translate(vec3(7.3,1.2,0));
-  MVP *= translateBall;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  if(!flg[2])
-    draw3DObject(t_ball3);
-  // Target balls
-
-  // cannon
-  Matrices.model = mat4(1.0f);
-  MVP = VP * translateAxes;
-  mat4 translateCannon = translate (vec3(1, .3, 0));        // glTranslatef
-  mat4 rotateCannon = rotate((float)(cannon_rotation*M_PI/180.0f), vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translateCannon * rotateCannon);
-  MVP *= Matrices.model;
-  translateCannon = translate(vec3(0,.5,0));
-  MVP *= translateCannon;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(cannon);
-
-  // blueball
-  translateCannon = translate(vec3(0,-.5,0));
-  MVP *= translateCannon;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(blueball);
-
-  // pivot
-  Matrices.model = mat4(1.0f);
-  MVP = VP * Matrices.model;
-  MVP *= translateAxes;
-  mat4 translatePivot = translate(vec3(1,.8,0));
-  MVP *= translatePivot;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(pivot);
-
-  // ball
-  if(!shot)
-  {
-    Matrices.model = mat4(1.0f);
-    MVP = VP * Matrices.model;
-    MVP *= translateAxes;
-    translateBall = translate (vec3(1, .3, 0));
-    mat4 rotateBall = rotate((float)(cannon_rotation*M_PI/180.0f), vec3(0,0,1)); // rotate about vector (-1,1,1)
-    Matrices.model *= (translateBall * rotateBall);
-    MVP *= Matrices.model;
-    translateBall = translate(vec3(0,.86,0));
-    MVP *= translateBall;
-    ballx_initial = -std::sin(cannon_rotation*M_PI/180.0f);
-    bally_initial = std::cos(cannon_rotation*M_PI/180.0f);
-    speedx_initial = -speed*std::sin(cannon_rotation*M_PI/180.f);
-    speedy_initial = speed*std::cos(cannon_rotation*M_PI/180.f);
-  }
-  else
-  {
-    delta_t += .1;
-    ballx_initial += speedx_initial * delta_t;
-    bally_initial += speedy_initial * delta_t + .5 * gravity * delta_t * delta_t;
-    speedy_final = speedy_initial + gravity * delta_t;
-    for(int i = 0 ; i < 3 ; i++)
-    {
-      if(!flg[i])
-      {
-        float dx = a[i][0]-ballx_initial, dy = a[i][1]-bally_initial;
-        float total_radius = a[i][2] + radius;
-        if(dx*dx + dy*dy <= total_radius*total_radius)
-        {
-          flg[i] = true;
-          score++;
-        }
-      }
-    }
-
-    // rebound x
-    if(ballx_initial - xoffset > 4.0f || ballx_initial + 4.0f - xoffset < 0)
-      speedx_initial = -1 * (speedx_initial - speedx_initial * (.05f));
-
-    // rebound y
-    if(bally_initial < -0.8f || bally_initial > 8.0f - 0.8f)
-      speedy_initial = -1 * (speedy_final - speedy_final * (.05f));
-    if(bally_initial < -2)
-      return;
-    // if(bally_initial + yoffset < 0 || bally_initial > 8.0 - yoffset)
-    //   speedy_initial = -1 * (speedy_final - speedy_final * (.05f));
-
-    translateBall = translate(vec3(ballx_initial, bally_initial, 0));
-    MVP *= translateBall;
+  mat4 VPAxes = VP * translateAxes;
+
+  // Only the parts below the mount move, and only while it turns
+  profile_begin(PROFILE_TRANSFORMS);
+  transform_set(scene, cannon[CANNON_MOUNT], 0, -.5, cannon_rotation);
+  transform_update(scene);
+  profile_end(PROFILE_TRANSFORMS);
+
+  // Hit targets disappear
+  for (size_t i = 0; i < scene.archetypes.size(); i++) {
+    Archetype& a = *scene.archetypes[i];
+    if (a.mask & COMPONENT_TARGET)
+      for (int k = 0; k < a.count; k++)
+        a.hit[k] = view.hit[a.target[k]];
   }
 
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(ball);
-  // Increment angles
-  float increments;
-  if(cannon_rotation > 90)
-  {
-    cannon_rotation = -90;
-    increments = 0;
-  }
-  else if(cannon_rotation < -90)
-  {
-    cannon_rotation = 90;
-    increments = 0;
+  // Obstacles and the cannon, then the targets
+  static mat4 last_VPAxes;
+  bool camera_moved = VPAxes != last_VPAxes;
+  last_VPAxes = VPAxes;
+  profile_begin(PROFILE_SCENE);
+  drawEntities(VPAxes, camera_moved, false);
+  profile_end(PROFILE_SCENE);
+  profile_begin(PROFILE_TARGETS);
+  drawEntities(VPAxes, camera_moved, true);
+  profile_end(PROFILE_TARGETS);
+
+  // balls in flight
+  profile_begin(PROFILE_BALLS);
+  for (int i = 0; i < view.count; i++) {
+    float x = view.px[i] + (view.x[i] - view.px[i]) * alpha;
+    float y = view.py[i] + (view.y[i] - view.py[i]) * alpha;
+    setMVP(VPAxes * translate(vec3(x, y, 0)));
+    draw3DObject(ball);
   }
-  else increments = 5;
-  //camera_rotation_angle++; // Simulating camera rotation
-  if(cannon_rot_status)
-    cannon_rotation = cannon_rotation + increments*cannon_rot_dir*cannon_rot_status;
+  profile_end(PROFILE_BALLS);
+
+  if (show_profile)
+    drawProfile(VPAxes);
 }
 
 /* Initialise glfw window, I/O callbacks and the renderer to use */
@@ -816,7 +672,7 @@ GLFWwindow* initGLFW (int width, int height)
 
     glfwMakeContextCurrent(window);
     gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
-    glfwSwapInterval( 1 );
+    pacing_init();
 
     /* --- register callbacks with GLFW --- */
 
@@ -826,9 +682,6 @@ GLFWwindow* initGLFW (int width, int height)
     glfwSetFramebufferSizeCallback(window, reshapeWindow);
     glfwSetWindowSizeCallback(window, reshapeWindow);
 
-    /* Register function to handle window close */
-    glfwSetWindowCloseCallback(window, quit);
-
     /* Register function to handle keyboard input */
     glfwSetKeyCallback(window, keyboard);      // general keyboard input
     glfwSetCharCallback(window, keyboardChar);  // simpler specific character handling
@@ -846,72 +699,527 @@ GLFWwindow* initGLFW (int width, int height)
     /* Objects should be created before any other gl function and shaders */
 	// Create the models
 
-    create_cannon ();
-    create_blueball ();
-    create_pivot ();
-    create_ball ();
-    createTriangle ();
-    target_rectangle ();
-    target_triangle ();
-    target_ball1 ();
-    target_ball2 ();
-    target_ball3 ();
-    target_trepezium ();
+    create_level ();
+
+    reshapeWindow (window, width, height);
+
+    // Background color of the scene
+	setClearColor (0.8f, 0.023f, 0.3f, 0.38431f); // R, G, B, A
+
+    // The software backend has its own fixed function pipeline
+    if (render_backend == BACKEND_SOFTWARE)
+      return;
 
 	// Create and compile our GLSL program from the shaders
     programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
 	// Get a handle for our "MVP" uniform
     Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+    profile_init(true);
 
-
-    reshapeWindow (window, width, height);
-
-    // Background color of the scene
-	glClearColor (0.8f, 0.023f, 0.3f, 0.38431f); // R, G, B, A
 	glClearDepth (1.0f);
 
 	glEnable (GL_DEPTH_TEST);
 	glDepthFunc (GL_LEQUAL);
 
-	std::cout << "VENDOR: " << glGetString(GL_VENDOR) << '\n';
-	std::cout << "RENDERER: " << glGetString(GL_RENDERER) << '\n';
-	std::cout << "VERSION: " << glGetString(GL_VERSION) << '\n';
-	std::cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << '\n';
+	std::cerr << "VENDOR: " << glGetString(GL_VENDOR) << '\n';
+	std::cerr << "RENDERER: " << glGetString(GL_RENDERER) << '\n';
+	std::cerr << "VERSION: " << glGetString(GL_VERSION) << '\n';
+	std::cerr << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << '\n';
+}
+
+/* Command line options */
+struct Options {
+  int width, height;
+  int frames;
+  int threads;
+  int shoot_frame;
+  const char* snapshot;
+  const char* capture;
+  CaptureFormat capture_format;
+  std::vector<int> capture_frames;
+  size_t upload_budget;   // bytes of level meshes uploaded per frame
+  const char* record;
+  const char* replay;
+  const char* batch;
+  int solve;              // wall rebounds of --solve, -1 when not solving
+  bool render_thread;     // draw on a thread of its own
+} options = { 1280, 720, 100, 0, -1, NULL, NULL, CAPTURE_PNG, std::vector<int>(), 256 * 1024, NULL, NULL, NULL, -1, true };
+
+/* What the render thread draws, published by the main thread and not
+   changed after */
+struct Frame {
+  SimView view;
+  float alpha;            // how far the frame is between the last two steps of the view
+  int width, height;      // framebuffer size
+};
+TripleBuffer<Frame> frames;
+std::atomic<bool> render_stop(false);
+// The render thread sleeps on this while no new frame is published
+std::mutex frame_mutex;
+std::condition_variable frame_published;
+
+/* Frames are drawn from the newest the main thread published, the level
+   uploaded in between, paced as --pacing says. Taking a frame wakes the
+   main thread for the next one, which it steps while this one goes to
+   the GPU. */
+void renderLoop (GLFWwindow* window)
+{
+  trace_thread_name("render");
+  glfwMakeContextCurrent(window);
+  int width = framebuffer_width, height = framebuffer_height;
+  for (;;) {
+    pacing_wait();
+    {
+      std::unique_lock<std::mutex> lock(frame_mutex);
+      frame_published.wait(lock, [] { return render_stop || frames.fresh(); });
+    }
+    if (render_stop)
+      break;
+    TraceScope trace("frame");
+    frames.take();
+    glfwPostEmptyEvent();
+
+    const Frame& frame = frames.front();
+    if (frame.width != width || frame.height != height) {
+      width = frame.width;
+      height = frame.height;
+      resizeFrame(width, height);
+    }
+    uploadLevel(options.upload_budget);
+    capture_begin_frame();
+    draw(frame.view, frame.alpha);
+    capture_end_frame();
+    pacing_swap();
+    profile_begin(PROFILE_SWAP);
+    glfwSwapBuffers(window);
+    profile_end(PROFILE_SWAP);
+    pacing_end();
+    profile_frame();
+    if (stress.on)
+      stressFrame(frame.view.tick, false);
+  }
+  glfwMakeContextCurrent(NULL);
+}
+
+/* Steps the game up to now and hands the result to the render thread */
+void publishFrame ()
+{
+  TraceScope trace("publish frame");
+  Frame& frame = frames.back();
+  frame.alpha = sim_launch(glfwGetTime());
+  sim_wait();
+  sim_snapshot(frame.view);
+  frame.width = framebuffer_width;
+  frame.height = framebuffer_height;
+  frames.publish();
+  // Under the lock, or the render thread could miss it between its check and its wait
+  { std::lock_guard<std::mutex> lock(frame_mutex); }
+  frame_published.notify_one();
+}
+
+/* Back to the main thread with the GL context, if it ever left */
+void stopRenderer (GLFWwindow* window)
+{
+  if (!render_thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    render_stop = true;
+  }
+  frame_published.notify_one();
+  render_thread.join();
+  glfwMakeContextCurrent(window);
+}
+
+/* Input of a replay, each event is applied right before the step of its tick */
+std::vector<InputEvent> replay_events;
+size_t replay_next = 0;
+unsigned long replay_end = 0;   // steps in the replay
+
+void replayInput (unsigned long tick)
+{
+  for (; replay_next < replay_events.size() && replay_events[replay_next].tick <= tick; replay_next++) {
+    const InputEvent& e = replay_events[replay_next];
+    if (e.type != INPUT_END)
+      applyKey(tick, e.key, e.type == INPUT_PRESS ? GLFW_PRESS : GLFW_RELEASE);
+  }
+}
+
+/* A replay without rendering, as fast as the steps go */
+void runReplay ()
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long tick = 0; tick < replay_end; tick++) {
+    replayInput(tick);
+    sim_tick();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << replay_end << " steps in " << seconds << "s (" << replay_end / seconds << " steps/s, "
+            << integrate_kernel_name() << " physics)\n";
+}
+
+/* Render frames on the CPU only, without a window or a GL context.
+   Every frame advances the game by exactly one step, so a run is reproducible. */
+void runSoftware ()
+{
+  sr_init(options.width, options.height, options.threads);
+  initGL (NULL, options.width, options.height);
+  // Every frame has to show the whole level for runs to be reproducible
+  while (!uploadLevel(SIZE_MAX))
+    std::this_thread::yield();
+
+  SimView view;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < options.frames; frame++) {
+    TraceScope trace("frame");
+    replayInput(frame);
+    if (frame == options.shoot_frame)
+      applyKey(frame, GLFW_KEY_SPACE, GLFW_RELEASE);
+    sim_tick();
+    sim_snapshot(view);
+    draw(view, 1);
+    finishFrame();
+    capture_end_frame();
+    profile_frame();
+    if (stress.on)
+      stressFrame(view.tick, frame + 1 == options.frames);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << options.frames << " frames in " << seconds << "s (" << options.frames / seconds << " fps, "
+            << integrate_kernel_name() << " physics)\n";
+
+  if (options.snapshot && !write_png(options.snapshot, sr_width(), sr_height(), (const unsigned char*) sr_pixels(), sr_stride(), false))
+    std::cerr << "Could not write " << options.snapshot << '\n';
+  capture_shutdown();
+  sr_shutdown();
+}
+
+/* Scores every shot of the file ("-" is stdin) and prints one line per
+   shot: angle speed spread burst score steps and the targets hit */
+void runBatch (const char* path)
+{
+  FILE* fp = strcmp(path, "-") ? fopen(path, "r") : stdin;
+  if (!fp) {
+    std::cerr << "Could not open " << path << '\n';
+    exit(EXIT_FAILURE);
+  }
+  std::vector<Shot> shots;
+  bool ok = batch_read(fp, shots);
+  if (fp != stdin)
+    fclose(fp);
+  if (!ok)
+    exit(EXIT_FAILURE);
+
+  std::vector<ShotResult> results;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  batch_run(shots, results);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (size_t i = 0; i < shots.size(); i++) {
+    const Shot& s = shots[i];
+    const ShotResult& r = results[i];
+    printf("%g %g %d %d %d %d ", s.angle, s.speed, s.spread, s.burst, r.score, r.steps);
+    for (size_t h = 0; h < r.hits.size(); h++)
+      printf(h ? ",%d" : "%d", r.hits[h]);
+    printf(r.hits.empty() ? "-\n" : "\n");
+  }
+  std::cerr << shots.size() << " shots in " << seconds << "s (" << shots.size() / seconds << " shots/s, "
+            << jobs_threads() << " threads)\n";
+}
+
+/* Prints the shots that reach each target with up to 'rebounds' wall
+   rebounds, as --batch input, and which targets cannot be reached at all */
+bool runSolver (int rebounds)
+{
+  std::vector<ShotSolution> solutions;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  solve_level(0.5f, rebounds, solutions);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<int> reachable(targets.size(), 0);
+  for (size_t i = 0; i < solutions.size(); i++) {
+    const ShotSolution& s = solutions[i];
+    if (s.blocked)
+      continue;
+    reachable[s.target]++;
+    printf("%g %g # target %d, %d rebounds, %.2fs\n", s.angle, s.speed, s.target, s.rebounds, s.time);
+  }
+  bool all = true;
+  for (size_t t = 0; t < targets.size(); t++) {
+    if (!reachable[t]) {
+      std::cerr << "Target " << t << " cannot be reached\n";
+      all = false;
+    }
+  }
+  std::cerr << solutions.size() << " solutions in " << seconds * 1e6 << "us\n";
+  return all;
+}
+
+/* "10,40,90" -> {10, 40, 90} */
+std::vector<int> parseList (const char* text)
+{
+  std::vector<int> values;
+  while (*text) {
+    char* end;
+    values.push_back(strtol(text, &end, 10));
+    text = *end ? end + 1 : end;
+  }
+  return values;
+}
+
+/* A trace still running is written whichever way the game exits */
+void finishTrace ()
+{
+  trace_stop();
 }
 
 int main (int argc, char** argv)
 {
-	int width = 1280;
-	int height = 720;
+  trace_thread_name("main");
+  trace_install_signal();
+  atexit(finishTrace);
+
+  // The level comes first, the other options work on its state. A replay
+  // brings its own unless another one is given.
+  InputStart replay_start;
+  for (int i = 1; i + 1 < argc; i++)
+    if (!strcmp(argv[i], "--replay"))
+      options.replay = argv[i + 1];
+  if (options.replay) {
+    if (!input_read(options.replay, replay_start, replay_events))
+      exit(EXIT_FAILURE);
+    level_path = replay_start.level.c_str();
+    replay_end = replay_events.empty() ? 0 : replay_events.back().tick;
+  }
+  for (int i = 1; i + 1 < argc; i++) {
+    if (!strcmp(argv[i], "--level"))
+      level_path = argv[i + 1];
+    else if (!strcmp(argv[i], "--stress")) {
+      stress.on = true;
+      if (sscanf(argv[i + 1], "%d,%d,%d", &stress.targets, &stress.obstacles, &stress.balls) != 3 ||
+          stress.targets < 0 || stress.obstacles < 0 || stress.balls < 0) {
+        std::cerr << "--stress takes targets,obstacles,balls\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (!strcmp(argv[i], "--seed"))
+      stress.seed = strtoul(argv[i + 1], NULL, 10);
+  }
+  if (!loadLevel())
+    exit(EXIT_FAILURE);
+  // The stress balls leave the usual room for shots
+  sim_reset(sim, MAX_PROJECTILES + stress.balls);
+  stress_balls(sim, stress.balls, stress.seed);
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--software"))
+      render_backend = BACKEND_SOFTWARE;
+    else if (!strcmp(argv[i], "--size") && i + 1 < argc)
+      sscanf(argv[++i], "%dx%d", &options.width, &options.height);
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+      options.threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+      options.frames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--angle") && i + 1 < argc)
+      sim.cannon_rotation = sim.prev_rotation = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+      controls.speed = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--spread") && i + 1 < argc)
+      controls.spread = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--burst") && i + 1 < argc)
+      controls.burst = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--simd") && i + 1 < argc) {
+      if (!integrate_select(argv[++i])) {
+        std::cerr << "No " << argv[i] << " kernel on this machine\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (!strcmp(argv[i], "--jobs") && i + 1 < argc)
+      jobs_init(atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--broadphase") && i + 1 < argc) {
+      if (!sim_set_broadphase(argv[++i])) {
+        std::cerr << "Unknown broad phase " << argv[i] << "\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if ((!strcmp(argv[i], "--level") || !strcmp(argv[i], "--replay") ||
+              !strcmp(argv[i], "--stress") || !strcmp(argv[i], "--seed")) && i + 1 < argc)
+      i++;
+    else if (!strcmp(argv[i], "--batch") && i + 1 < argc)
+      options.batch = argv[++i];
+    else if (!strcmp(argv[i], "--solve") && i + 1 < argc)
+      options.solve = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+      options.record = argv[++i];
+    else if (!strcmp(argv[i], "--pacing") && i + 1 < argc) {
+      if (!pacing_set_mode(argv[++i])) {
+        std::cerr << "Unknown pacing " << argv[i] << "\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+      profile_logging = true;
+      profile_log_every(atof(argv[++i]));
+      profile_enable(true);
+    }
+    else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+      trace_set_path(argv[++i]);
+      trace_start();
+    }
+    else if (!strcmp(argv[i], "--no-render-thread"))
+      options.render_thread = false;
+    else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+      pacing_set_mode("cap");
+      if (!pacing_set_fps(atof(argv[++i]))) {
+        std::cerr << "--fps takes a positive rate, not " << argv[i] << "\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (!strcmp(argv[i], "--upload-budget") && i + 1 < argc)
+      options.upload_budget = atoi(argv[++i]) * 1024;
+    else if (!strcmp(argv[i], "--sim-hz") && i + 1 < argc) {
+      if (!sim_set_rate(atof(argv[++i]))) {
+        std::cerr << "--sim-hz takes a positive rate, not " << argv[i] << "\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (!strcmp(argv[i], "--shoot") && i + 1 < argc)
+      options.shoot_frame = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--snapshot") && i + 1 < argc)
+      options.snapshot = argv[++i];
+    else if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+      options.capture = argv[++i];
+      options.capture_format = CAPTURE_PNG;
+    }
+    else if (!strcmp(argv[i], "--capture-raw") && i + 1 < argc) {
+      options.capture = argv[++i];
+      options.capture_format = CAPTURE_RAW;
+    }
+    else if (!strcmp(argv[i], "--capture-frames") && i + 1 < argc)
+      options.capture_frames = parseList(argv[++i]);
+    else {
+      std::cerr << "Unknown option " << argv[i] << '\n';
+      exit(EXIT_FAILURE);
+    }
+  }
+  capture_only(options.capture_frames);
+
+  if (options.solve >= 0)
+    exit(runSolver(options.solve) ? EXIT_SUCCESS : EXIT_FAILURE);
+  if (options.batch) {
+    runBatch(options.batch);
+    jobs_shutdown();
+    exit(EXIT_SUCCESS);
+  }
+
+  // A replay starts from the recorded settings whatever the options say
+  if (options.replay) {
+    if (!sim_set_rate(replay_start.step_rate)) {
+      std::cerr << options.replay << " has a step rate of " << replay_start.step_rate << " Hz\n";
+      exit(EXIT_FAILURE);
+    }
+    sim.cannon_rotation = sim.prev_rotation = replay_start.cannon_rotation;
+    controls.speed = replay_start.speed;
+    controls.spread = replay_start.spread;
+    controls.burst = replay_start.burst;
+    options.frames = replay_end;
+  }
+  if (options.record && stress.on) {
+    std::cerr << "A --stress scene cannot be recorded\n";
+    exit(EXIT_FAILURE);
+  }
+  if (options.record) {
+    InputStart start = { sim_rate(), sim.cannon_rotation, controls.speed, controls.spread, controls.burst, level_path };
+    if (!input_record_start(options.record, start))
+      exit(EXIT_FAILURE);
+  }
+
+  if (options.replay && render_backend != BACKEND_SOFTWARE) {
+    runReplay();
+    input_record_stop(sim_input_tick());
+    jobs_shutdown();
+    printScore();
+    exit(EXIT_SUCCESS);
+  }
+
+  if (render_backend == BACKEND_SOFTWARE) {
+    if (options.capture && !capture_init(options.capture, options.capture_format, false))
+      exit(EXIT_FAILURE);
+    runSoftware();
+    input_record_stop(sim_input_tick());
+    jobs_shutdown();
+    loader_stop();
+    printScore();
+    exit(EXIT_SUCCESS);
+  }
+
+	int width = options.width;
+	int height = options.height;
 
   GLFWwindow* window = initGLFW(width, height);
 
+  // Recording must not slow the game down, frames are dropped instead
+  if (options.capture && !capture_init(options.capture, options.capture_format, true))
+    exit(EXIT_FAILURE);
+
   initGL (window, width, height);
+  sim_set_input(drainKeys);
+
+  if (options.render_thread) {
+    glfwMakeContextCurrent(NULL);
+    render_thread = std::thread(renderLoop, window);
+
+        // Events and steps only: a new frame whenever input comes in or the
+        // render thread took the last one. The timeout only guards against
+        // a lost wake up.
+    while (!glfwWindowShouldClose(window)) {
+      trace_poll();
+      publishFrame();
+      profile_begin(PROFILE_POLL);
+      glfwWaitEventsTimeout(0.1);
+      profile_end(PROFILE_POLL);
+    }
+  }
 
-  double last_update_time = glfwGetTime(), current_time;
+  SimView view;
+  double alpha = 0;
 
     /* Draw in loop */
-  while (!glfwWindowShouldClose(window)) {
+  while (!options.render_thread && !glfwWindowShouldClose(window)) {
+    trace_poll();
+    TraceScope trace("frame");
+
+        // Held back as the pacing mode asks, then input is read as late
+        // as it can be, right before the steps it goes into
+    pacing_wait();
+    sim_wait();
+    profile_begin(PROFILE_POLL);
+    glfwPollEvents();
+    profile_end(PROFILE_POLL);
+
+        // Physics catches up with the clock in fixed steps on the job system,
+        // meanwhile the state the previous steps left is drawn
+    sim_snapshot(view);
+    double view_alpha = alpha;
+    alpha = sim_launch(glfwGetTime());
+
+        // Level meshes the loader finished since the last frame
+    uploadLevel(options.upload_budget);
 
         // OpenGL Draw commands
-    draw();
+    capture_begin_frame();
+    draw(view, view_alpha);
+    capture_end_frame();
 
         // Swap Frame Buffer in double buffering
+    pacing_swap();
+    profile_begin(PROFILE_SWAP);
     glfwSwapBuffers(window);
-
-        // Poll for Keyboard and mouse events
-    glfwPollEvents();
-
-        // Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
-        current_time = glfwGetTime(); // Time in seconds
-        if ((current_time - last_update_time) >= 0.5) { // atleast 0.5s elapsed since last frame
-            // do something every 0.5 seconds ..
-          last_update_time = current_time;
-        }
+    profile_end(PROFILE_SWAP);
+    pacing_end();
+    profile_frame();
+    if (stress.on)
+      stressFrame(view.tick, false);
       }
 
-
-      glfwTerminate();
-      std::cout << score << '\n';
-      exit(EXIT_SUCCESS);
+      quit(window);
     }
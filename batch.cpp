@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "batch.h"
+#include "simulation.h"
+#include "jobs.h"
+
+// Shots per job, each job sets one state up for all of them
+#define SHOTS_PER_JOB 64
+
+bool batch_read (FILE* fp, std::vector<Shot>& shots)
+{
+  char line[256];
+  for (int number = 1; fgets(line, sizeof(line), fp); number++) {
+    char* comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+    Shot shot = { 0, 0, 1, 1 };
+    int fields = sscanf(line, "%f %f %d %d", &shot.angle, &shot.speed, &shot.spread, &shot.burst);
+    if (fields == EOF)
+      continue;
+    if (fields < 2) {
+      std::cerr << "batch: line " << number << ": expected angle speed [spread [burst]]\n";
+      return false;
+    }
+    shots.push_back(shot);
+  }
+  return true;
+}
+
+struct BatchJob {
+  const Shot* shots;
+  ShotResult* results;
+};
+
+static void runShots (void* data, int begin, int end)
+{
+  BatchJob* job = (BatchJob*) data;
+  int most = 1;
+  for (int i = begin; i < end; i++)
+    most = std::max(most, std::max(job->shots[i].spread, 1) * std::max(job->shots[i].burst, 1));
+  SimState s;
+  float dt = 1.0 / sim_rate();
+  for (int i = begin; i < end; i++) {
+    const Shot& shot = job->shots[i];
+    ShotResult& r = job->results[i];
+    sim_reset(s, most);
+    s.cannon_rotation = s.prev_rotation = shot.angle;
+    Controls c = { false, 1, shot.speed, shot.spread, shot.burst, true };
+    do {
+      sim_step(s, c, dt);
+      c.fire = false;
+    } while ((s.balls.count > 0 || s.burst_left > 0) && s.score < (int)targets.size());
+    r.score = s.score;
+    r.steps = s.tick;
+    r.hits.clear();
+    for (size_t t = 0; t < s.hit.size(); t++)
+      if (s.hit[t])
+        r.hits.push_back(t);
+  }
+}
+
+void batch_run (const std::vector<Shot>& shots, std::vector<ShotResult>& results)
+{
+  results.resize(shots.size());
+  if (shots.empty())
+    return;
+  BatchJob job = { &shots[0], &results[0] };
+  JobCounter done;
+  jobs_parallel_for(runShots, &job, shots.size(), SHOTS_PER_JOB, &done);
+  jobs_wait(&done);
+}
@@ -0,0 +1,28 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdio>
+#include <vector>
+
+/* Scores shots without a window: every shot runs in a fresh state of its
+   own until its balls are gone or every target is hit, and the shots of a
+   batch are spread over all cores of the job system. */
+
+struct Shot {
+  float angle;   // degrees, as the cannon rotation
+  float speed;
+  int spread, burst;
+};
+
+struct ShotResult {
+  int score;
+  int steps;
+  std::vector<int> hits;   // targets hit
+};
+
+/* Shots one per line, "angle speed [spread [burst]]", '#' starts a comment.
+   False on a malformed line. */
+bool batch_read (FILE* fp, std::vector<Shot>& shots);
+void batch_run (const std::vector<Shot>& shots, std::vector<ShotResult>& results);
+
+#endif
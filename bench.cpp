@@ -0,0 +1,475 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "render.h"
+#include "soft_raster.h"
+#include "simulation.h"
+#include "integrate.h"
+#include "jobs.h"
+#include "loader.h"
+#include "ecs.h"
+
+/* Micro-benchmarks of the renderer and physics hot paths. Every workload
+   is fixed: the same sizes and seeded data on every run, and state that
+   a benchmark uses up is restored between timed batches. A benchmark
+   runs in batches sized to take --min-time seconds, --repeats times, and
+   the median batch is reported. A benchmark whose state changes as it
+   runs, like balls hitting targets, resets every 'chunk' operations so a
+   long batch times the same work as a short one. Results are JSON on stdout, so runs of
+   different commits can be compared. */
+
+struct Benchmark {
+  const char* name;
+  const char* unit;       // what items per second counts
+  double items;           // per operation
+  bool (*setup) ();       // false when it cannot run here
+  void (*run) (long ops);
+  void (*reset) ();       // untimed, before every batch, may be NULL
+  long chunk;             // operations between resets at most, 0 for no limit
+  double (*counted) ();   // items per operation of the last run, NULL for 'items'
+};
+
+static bool gl = false;
+static volatile float sink;   // keeps results from being optimized away
+
+/* Reseeded before every benchmark, so each sees the same data whichever
+   others run */
+#define SEED 12345
+static unsigned int seed = SEED;
+static float random01 ()
+{
+  seed = seed * 1664525u + 1013904223u;
+  return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+static bool always () { return true; }
+
+/* ---- meshes ---- */
+
+#define MESH_VERTICES 4096
+static std::vector<float> mesh_vertices, mesh_colors;
+
+static bool mesh_setup ()
+{
+  mesh_vertices.resize(3 * MESH_VERTICES);
+  mesh_colors.resize(3 * MESH_VERTICES);
+  for (int i = 0; i < 3 * MESH_VERTICES; i++) {
+    mesh_vertices[i] = random01() * 8;
+    mesh_colors[i] = random01();
+  }
+  return true;
+}
+
+static void create_objects (long ops)
+{
+  for (long i = 0; i < ops; i++)
+    destroy3DObject(create3DObject(GL_TRIANGLES, MESH_VERTICES, &mesh_vertices[0], &mesh_colors[0], GL_FILL));
+  if (render_backend == BACKEND_GL)
+    glFinish();
+}
+
+static bool create_software () { render_backend = BACKEND_SOFTWARE; return mesh_setup(); }
+static bool create_gl () { render_backend = BACKEND_GL; return gl && mesh_setup(); }
+
+static void circles (long ops)
+{
+  static const float color[3] = { 1, 0, 0 };
+  LevelMesh mesh;
+  for (long i = 0; i < ops; i++) {
+    loader_circle(&mesh, color);
+    sink = mesh.vertices[3];
+  }
+}
+
+/* ---- matrices ---- */
+
+static glm::mat4 VPAxes;
+static Affine affine;
+
+static bool mvp_setup ()
+{
+  VPAxes = glm::perspective(90.0f, 16.0f / 9, 0.1f, 500.0f) * glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)) * glm::translate(glm::vec3(-4,-4,0));
+  float angle = random01() * 6.2831853f, scale = .5f + random01();
+  affine.m[0] = scale * cos(angle);
+  affine.m[1] = scale * sin(angle);
+  affine.m[2] = -affine.m[1];
+  affine.m[3] = affine.m[0];
+  affine.m[4] = random01() * 8;
+  affine.m[5] = random01() * 8;
+  return true;
+}
+
+/* The composition draw() does for an entity that moved */
+static void mvps (long ops)
+{
+  for (long i = 0; i < ops; i++) {
+    const float* w = affine.m;
+    glm::mat4 model(1.0f);
+    model[0][0] = w[0];
+    model[0][1] = w[1];
+    model[1][0] = w[2];
+    model[1][1] = w[3];
+    model[3][0] = w[4] + i * 1e-6f;
+    model[3][1] = w[5];
+    glm::mat4 MVP = VPAxes * model;
+    sink = MVP[3][0];
+  }
+}
+
+#define HIERARCHY 1024
+static World world;
+static Entity root;
+
+/* A root turning every operation, with chains of four below it */
+static bool hierarchy_setup ()
+{
+  world_clear(world);
+  root = world_create(world, COMPONENT_TRANSFORM);
+  for (int i = 0; i < HIERARCHY - 1; i++) {
+    Entity e = world_create(world, COMPONENT_TRANSFORM | COMPONENT_RENDERABLE);
+    transform_attach(world, e, i % 4 == 0 ? root : e - 1);
+    transform_set(world, e, random01(), random01(), random01() * 360, .5f + random01());
+  }
+  transform_update(world);
+  return true;
+}
+
+static void hierarchies (long ops)
+{
+  for (long i = 0; i < ops; i++) {
+    transform_set(world, root, 4, 4, i % 360);
+    sink = transform_update(world);
+  }
+}
+
+/* ---- draw submission ---- */
+
+static VAO* circle;
+
+static bool draw_setup ()
+{
+  static const float color[3] = { 0, 1, 0 };
+  LevelMesh mesh;
+  loader_circle(&mesh, color);
+  circle = create3DObject(GL_TRIANGLE_FAN, CIRCLE_POINTS, &mesh.vertices[0], &mesh.colors[0], GL_FILL);
+  useProgram();
+  setMVP(glm::scale(glm::vec3(.01f, .01f, 1)));
+  return true;
+}
+
+static bool draw_software ()
+{
+  render_backend = BACKEND_SOFTWARE;
+  sr_viewport(1280, 720);
+  return draw_setup();
+}
+
+static bool draw_gl ()
+{
+  render_backend = BACKEND_GL;
+  return gl && draw_setup();
+}
+
+static void draws (long ops)
+{
+  for (long i = 0; i < ops; i++)
+    draw3DObject(circle);
+  if (render_backend == BACKEND_GL)
+    glFinish();
+}
+
+/* Software draws are only binned, the tiles are rasterized in between */
+static void draws_reset ()
+{
+  if (render_backend == BACKEND_SOFTWARE)
+    sr_finish();
+}
+
+#define RASTER_DRAWS 256
+
+/* A whole software frame: clear, a scatter of circles, rasterize */
+static void raster_frames (long ops)
+{
+  for (long i = 0; i < ops; i++) {
+    sr_clear();
+    for (int k = 0; k < RASTER_DRAWS; k++) {
+      float x = -1 + 2 * ((k * 37) % 256) / 256.0f, y = -1 + 2 * ((k * 91) % 256) / 256.0f;
+      setMVP(glm::translate(glm::vec3(x, y, 0)) * glm::scale(glm::vec3(.05f, .05f, 1)));
+      draw3DObject(circle);
+    }
+    sr_finish();
+  }
+}
+
+/* ---- physics ---- */
+
+#define BALLS MAX_PROJECTILES
+static Projectiles balls;
+static IntegrateParams params;
+
+static void balls_reset ()
+{
+  seed = 777;
+  projectiles_clear(balls);
+  for (int i = 0; i < BALLS; i++)
+    projectiles_spawn(balls, .2f + random01() * 7.6f, .2f + random01() * 7.6f, random01() * 20 - 10, random01() * 20 - 10, BALL_LIFETIME);
+}
+
+static bool integrate_setup (const char* kernel)
+{
+  if (!integrate_select(kernel))
+    return false;
+  projectiles_init(balls, BALLS);
+  // As sim_step() has them
+  float dt = 1 / 60.0f;
+  IntegrateParams k = { dt, 0.5f * gravity * dt * dt, gravity * dt, -(1 - damping),
+                        wall_left, wall_right, wall_bottom, wall_top };
+  params = k;
+  return true;
+}
+
+/* Every kernel the CPU has runs the same balls for a few hundred steps,
+   with rebounds, expiry and a tail shorter than a vector, and must match
+   the scalar kernel bit for bit. Name of the first that does not, NULL
+   when they all do. */
+static const char* kernel_mismatch ()
+{
+  static const char* kernels[] = { "sse2", "avx2", "neon" };
+  Projectiles reference;
+  const char* mismatch = NULL;
+  for (int n = -1; n < (int)(sizeof(kernels) / sizeof(kernels[0])); n++) {
+    if (!integrate_setup(n < 0 ? "scalar" : kernels[n]))
+      continue;
+    balls_reset();
+    // Not a multiple of 8, the scalar tail runs too
+    int count = BALLS - 5;
+    for (int step = 0; step < 700; step++)
+      integrate(balls, params, 0, count);
+    if (n < 0) {
+      reference = balls;
+      continue;
+    }
+    size_t bytes = count * sizeof(float);
+    if (memcmp(&balls.x[0], &reference.x[0], bytes) || memcmp(&balls.y[0], &reference.y[0], bytes) ||
+        memcmp(&balls.vx[0], &reference.vx[0], bytes) || memcmp(&balls.vy[0], &reference.vy[0], bytes) ||
+        memcmp(&balls.px[0], &reference.px[0], bytes) || memcmp(&balls.py[0], &reference.py[0], bytes) ||
+        memcmp(&balls.life[0], &reference.life[0], bytes) || memcmp(&balls.alive[0], &reference.alive[0], count) ||
+        memcmp(&balls.bounced[0], &reference.bounced[0], count)) {
+      mismatch = kernels[n];
+      break;
+    }
+  }
+  integrate_select("auto");
+  return mismatch;
+}
+
+static bool integrate_scalar () { return integrate_setup("scalar"); }
+static bool integrate_sse2 () { return integrate_setup("sse2"); }
+static bool integrate_avx2 () { return integrate_setup("avx2"); }
+static bool integrate_neon () { return integrate_setup("neon"); }
+
+static void integrates (long ops)
+{
+  for (long i = 0; i < ops; i++)
+    integrate(balls, params, 0, balls.count);
+}
+
+/* A level of 64 targets and 64 obstacles, every ball in play */
+static bool collision_setup (const char* broadphase)
+{
+  integrate_select("auto");
+  seed = 4242;
+  std::vector<Target> list(64);
+  for (size_t i = 0; i < list.size(); i++) {
+    list[i].x = .5f + random01() * 7;
+    list[i].y = .5f + random01() * 7;
+    list[i].radius = .05f + random01() * .1f;
+  }
+  std::vector<Polygon> shapes(64);
+  for (size_t i = 0; i < shapes.size(); i++) {
+    float size = .05f + random01() * .2f, square[] = { 0,0,0, size,0,0, size,size,0, 0,size,0 };
+    polygon_from_vertices(square, 4, .5f + random01() * 7, .5f + random01() * 7, shapes[i]);
+  }
+  sim_set_targets(list);
+  sim_set_obstacles(shapes);
+  return sim_set_broadphase(broadphase);
+}
+
+static bool collision_grid () { return collision_setup("grid"); }
+static bool collision_bvh () { return collision_setup("bvh"); }
+
+static SimState state;
+
+static long stepped, stepped_balls;
+
+/* Balls that never expire, none starting inside a target */
+static void steps_reset ()
+{
+  sim_reset(state);
+  seed = 999;
+  while (state.balls.count < BALLS) {
+    float x = .2f + random01() * 7.6f, y = .2f + random01() * 7.6f;
+    float vx = random01() * 20 - 10, vy = random01() * 20 - 10;
+    bool clear = true;
+    for (size_t t = 0; t < targets.size() && clear; t++) {
+      float dx = x - targets[t].x, dy = y - targets[t].y, r = targets[t].radius + BALL_RADIUS;
+      clear = dx * dx + dy * dy > r * r;
+    }
+    if (clear)
+      projectiles_spawn(state.balls, x, y, vx, vy, INFINITY);
+  }
+  stepped = stepped_balls = 0;
+}
+
+static void steps (long ops)
+{
+  Controls c = { false, 1, 6, 1, 1, false };
+  for (long i = 0; i < ops; i++) {
+    stepped_balls += state.balls.count;
+    sim_step(state, c, 1 / 60.0f);
+  }
+  stepped += ops;
+}
+
+static double balls_stepped ()
+{
+  return stepped ? (double) stepped_balls / stepped : 0;
+}
+
+// Targets are hit within a second, so the level is set up again after this many steps
+#define STEPS_CHUNK 32
+
+static const Benchmark benchmarks[] = {
+  { "circle", "vertices", CIRCLE_POINTS, always, circles, NULL },
+  { "mvp", "matrices", 1, mvp_setup, mvps, NULL },
+  { "transform_update", "entities", HIERARCHY, hierarchy_setup, hierarchies, NULL },
+  { "create3DObject_software", "bytes", 6 * sizeof(float) * MESH_VERTICES, create_software, create_objects, NULL },
+  { "create3DObject_gl", "bytes", 6 * sizeof(float) * MESH_VERTICES, create_gl, create_objects, NULL },
+  { "draw3DObject_software", "draws", 1, draw_software, draws, draws_reset },
+  { "draw3DObject_gl", "draws", 1, draw_gl, draws, NULL },
+  { "raster_frame_software", "draws", RASTER_DRAWS, draw_software, raster_frames, NULL },
+  { "integrate_scalar", "balls", BALLS, integrate_scalar, integrates, balls_reset },
+  { "integrate_sse2", "balls", BALLS, integrate_sse2, integrates, balls_reset },
+  { "integrate_avx2", "balls", BALLS, integrate_avx2, integrates, balls_reset },
+  { "integrate_neon", "balls", BALLS, integrate_neon, integrates, balls_reset },
+  { "sim_step_grid", "balls", BALLS, collision_grid, steps, steps_reset, STEPS_CHUNK, balls_stepped },
+  { "sim_step_bvh", "balls", BALLS, collision_bvh, steps, steps_reset, STEPS_CHUNK, balls_stepped },
+};
+
+static double seconds (long ops, const Benchmark& b)
+{
+  double total = 0;
+  for (long done = 0; done < ops; ) {
+    long n = b.chunk ? std::min(b.chunk, ops - done) : ops - done;
+    if (b.reset)
+      b.reset();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    b.run(n);
+    total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    done += n;
+  }
+  return total;
+}
+
+/* A hidden window for the GL benchmarks, false where there is no display */
+static bool init_gl ()
+{
+  if (!glfwInit())
+    return false;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow* window = glfwCreateWindow(256, 256, "bench", NULL, NULL);
+  if (!window) {
+    glfwTerminate();
+    return false;
+  }
+  glfwMakeContextCurrent(window);
+  glfwSwapInterval(0);
+  if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress))
+    return false;
+  programID = LoadShaders("Sample_GL.vert", "Sample_GL.frag");
+  Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+  return programID != 0;
+}
+
+int main (int argc, char** argv)
+{
+  double min_time = 0.1;
+  int repeats = 5;
+  const char* filter = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--min-time") && i + 1 < argc)
+      min_time = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--repeats") && i + 1 < argc)
+      repeats = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+      filter = argv[++i];
+    else {
+      std::cerr << "Usage: bench [--filter text] [--min-time seconds] [--repeats n]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  gl = init_gl();
+  sr_init(1280, 720);
+  jobs_init();
+
+  const char* mismatch = kernel_mismatch();
+  if (mismatch)
+    std::cerr << "bench: the " << mismatch << " kernel does not match the scalar one\n";
+
+  printf("{\n  \"gl\": %s,\n  \"threads\": %d,\n  \"kernels_match\": %s,\n  \"benchmarks\": [",
+         gl ? "true" : "false", jobs_threads(), mismatch ? "false" : "true");
+  const char* separator = "";
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+    const Benchmark& b = benchmarks[i];
+    if (filter && !strstr(b.name, filter))
+      continue;
+    printf("%s\n    { \"name\": \"%s\", ", separator, b.name);
+    separator = ",";
+    seed = SEED;
+    if (!b.setup()) {
+      printf("\"skipped\": true }");
+      continue;
+    }
+
+    // Batches long enough for the clock, then the median of the repeats.
+    // Chunked ones in whole chunks, so every batch does the same work.
+    long ops = b.chunk ? b.chunk : 1;
+    while (seconds(ops, b) < min_time && ops < (1L << 40))
+      ops *= 2;
+    std::vector<double> times(repeats);
+    for (int r = 0; r < repeats; r++)
+      times[r] = seconds(ops, b);
+    std::sort(times.begin(), times.end());
+    double median = times[repeats / 2];
+    double items = b.counted ? b.counted() : b.items;
+    printf("\"ops\": %ld, \"ns_per_op\": %.3f, \"items_per_op\": %.6g, \"items_per_second\": %.6g, \"unit\": \"%s\" }",
+           ops, median * 1e9 / ops, items, items * ops / median, b.unit);
+    fflush(stdout);
+  }
+  printf("\n  ]\n}\n");
+
+  sr_shutdown();
+  jobs_shutdown();
+  if (gl)
+    glfwTerminate();
+  return mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cmath>
+
+#include "broadphase.h"
+
+// Keeps a level with a few huge shapes from allocating a huge grid
+#define MAX_GRID_CELLS (1 << 20)
+#define MAX_GRID_ITEMS (1 << 22)
+
+/* Range of cells a grown box overlaps, never the border */
+static void cell_range (const UniformGrid& g, const Box& b, int* cx0, int* cy0, int* cx1, int* cy1)
+{
+  const GridShape& s = g.shape;
+  float m = g.margin;
+  *cx0 = std::max(1, (int)((b.min_x - m - s.x0) * s.inv_cell));
+  *cy0 = std::max(1, (int)((b.min_y - m - s.y0) * s.inv_cell));
+  *cx1 = std::min(s.nx - 2, (int)((b.max_x + m - s.x0) * s.inv_cell));
+  *cy1 = std::min(s.ny - 2, (int)((b.max_y + m - s.y0) * s.inv_cell));
+}
+
+void grid_build (UniformGrid& g, const std::vector<Box>& boxes, float margin)
+{
+  GridShape& s = g.shape;
+  g.margin = margin;
+  g.live = boxes.size();
+  s.nx = s.ny = 1;
+  s.max_cx = s.max_cy = 0;
+  g.start.assign(2, 0);
+  g.count.assign(1, 0);
+  g.items.clear();
+  s.x0 = s.y0 = 0;
+  s.cell = s.inv_cell = 1;
+  if (boxes.empty())
+    return;
+
+  // Bounds of all boxes, cells about as wide as the narrow side of an
+  // average box: long thin ones span a few cells instead of filling them
+  float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY, size = 0;
+  for (size_t i = 0; i < boxes.size(); i++) {
+    const Box& b = boxes[i];
+    x0 = std::min(x0, b.min_x - margin);
+    y0 = std::min(y0, b.min_y - margin);
+    x1 = std::max(x1, b.max_x + margin);
+    y1 = std::max(y1, b.max_y + margin);
+    size += std::min(b.max_x - b.min_x, b.max_y - b.min_y) + 2 * margin;
+  }
+  s.cell = size / boxes.size();
+  while ((double)((x1 - x0) / s.cell + 3) * ((y1 - y0) / s.cell + 3) > MAX_GRID_CELLS)
+    s.cell *= 2;
+  for (;;) {
+    double items = 0;
+    for (size_t i = 0; i < boxes.size(); i++) {
+      const Box& b = boxes[i];
+      items += ((b.max_x - b.min_x + 2 * margin) / s.cell + 2) * ((b.max_y - b.min_y + 2 * margin) / s.cell + 2);
+    }
+    if (items <= MAX_GRID_ITEMS)
+      break;
+    s.cell *= 2;
+  }
+  s.inv_cell = 1 / s.cell;
+  s.x0 = x0 - s.cell;
+  s.y0 = y0 - s.cell;
+  s.nx = (int)((x1 - x0) * s.inv_cell) + 3;
+  s.ny = (int)((y1 - y0) * s.inv_cell) + 3;
+  s.max_cx = s.nx - 1;
+  s.max_cy = s.ny - 1;
+
+  // Counting sort of the (cell, box) pairs
+  g.count.assign(s.nx * s.ny, 0);
+  for (size_t i = 0; i < boxes.size(); i++) {
+    int cx0, cy0, cx1, cy1;
+    cell_range(g, boxes[i], &cx0, &cy0, &cx1, &cy1);
+    for (int cy = cy0; cy <= cy1; cy++)
+      for (int cx = cx0; cx <= cx1; cx++)
+        g.count[cy * s.nx + cx]++;
+  }
+  g.start.assign(s.nx * s.ny + 1, 0);
+  for (int c = 0; c < s.nx * s.ny; c++)
+    g.start[c + 1] = g.start[c] + g.count[c];
+  g.items.resize(g.start.back());
+  std::fill(g.count.begin(), g.count.end(), 0);
+  for (size_t i = 0; i < boxes.size(); i++) {
+    int cx0, cy0, cx1, cy1;
+    cell_range(g, boxes[i], &cx0, &cy0, &cx1, &cy1);
+    for (int cy = cy0; cy <= cy1; cy++) {
+      for (int cx = cx0; cx <= cx1; cx++) {
+        int c = cy * s.nx + cx;
+        g.items[g.start[c] + g.count[c]++] = i;
+      }
+    }
+  }
+}
+
+void grid_remove (UniformGrid& g, const Box& box, int index)
+{
+  g.live--;
+  int nx = g.shape.nx, cx0, cy0, cx1, cy1;
+  cell_range(g, box, &cx0, &cy0, &cx1, &cy1);
+  for (int cy = cy0; cy <= cy1; cy++) {
+    for (int cx = cx0; cx <= cx1; cx++) {
+      int c = cy * nx + cx;
+      int* items = &g.items[g.start[c]];
+      for (int k = 0; k < g.count[c]; k++) {
+        if (items[k] == index) {
+          items[k] = items[--g.count[c]];
+          break;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <vector>
+
+#include "colliders.h"
+
+/* Uniform grid over the bounding boxes of static shapes for the ball broad
+   phase. Every shape is listed in each cell its box, grown by the ball
+   radius, overlaps, so a ball only needs to look at the cells its step
+   crosses. Hit targets are taken out of their cells, nothing else changes
+   per step. A ring of empty cells surrounds the shapes, points outside of
+   the grid are clamped into it. */
+struct GridShape {
+  float x0, y0;          // corner of cell (0, 0)
+  float cell, inv_cell;
+  int nx, ny;
+  float max_cx, max_cy;  // nx - 1, ny - 1
+};
+
+struct UniformGrid {
+  GridShape shape;
+  float margin;          // added on every side of a box
+  int live;              // shapes still in the grid
+  std::vector<int> start;   // first item of each cell
+  std::vector<int> count;   // live items of each cell, they are packed at the start
+  std::vector<int> items;   // shape indices
+};
+
+void grid_build (UniformGrid& g, const std::vector<Box>& boxes, float margin);
+void grid_remove (UniformGrid& g, const Box& box, int index);
+
+/* Cells overlapping the box from (x0, y0) to (x1, y1), clamped into the
+   border. No branches: balls fly in and out of the grid at random. */
+inline void grid_range (const GridShape& g, float x0, float y0, float x1, float y1, int* cx0, int* cy0, int* cx1, int* cy1)
+{
+  // Written so they compile to maxss/minss, a clamp against 0 would not,
+  // and neither would a clamp inside the conversion to int
+  x0 = x0 > g.x0 ? x0 : g.x0;
+  y0 = y0 > g.y0 ? y0 : g.y0;
+  x1 = x1 > g.x0 ? x1 : g.x0;
+  y1 = y1 > g.y0 ? y1 : g.y0;
+  float fx0 = (x0 - g.x0) * g.inv_cell, fy0 = (y0 - g.y0) * g.inv_cell;
+  float fx1 = (x1 - g.x0) * g.inv_cell, fy1 = (y1 - g.y0) * g.inv_cell;
+  fx0 = fx0 < g.max_cx ? fx0 : g.max_cx;
+  fy0 = fy0 < g.max_cy ? fy0 : g.max_cy;
+  fx1 = fx1 < g.max_cx ? fx1 : g.max_cx;
+  fy1 = fy1 < g.max_cy ? fy1 : g.max_cy;
+  *cx0 = (int)fx0;
+  *cy0 = (int)fy0;
+  *cx1 = (int)fx1;
+  *cy1 = (int)fy1;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include <algorithm>
+
+#include "bvh.h"
+
+// Centroid bins tried per axis when splitting a node
+#define BVH_BINS 16
+// A leaf never holds more shapes than this, unless they cannot be split
+#define BVH_MAX_LEAF 4
+// Cost of visiting an inner node against testing one shape
+#define BVH_TRAVERSAL_COST 1.0f
+
+static Box empty_box ()
+{
+  Box b = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+  return b;
+}
+
+static void grow (Box& b, const Box& o)
+{
+  b.min_x = std::min(b.min_x, o.min_x);
+  b.min_y = std::min(b.min_y, o.min_y);
+  b.max_x = std::max(b.max_x, o.max_x);
+  b.max_y = std::max(b.max_y, o.max_y);
+}
+
+/* Half the perimeter: in 2D the chance a random segment crosses a box */
+static float half_perimeter (const Box& b)
+{
+  return b.max_x < b.min_x ? 0 : (b.max_x - b.min_x) + (b.max_y - b.min_y);
+}
+
+struct BuildState {
+  std::vector<Box> boxes;        // grown
+  std::vector<float> cx, cy;     // centroids
+};
+
+static int build (Bvh& b, BuildState& s, int first, int count, int depth)
+{
+  int n = b.nodes.size();
+  b.nodes.push_back(BvhNode());
+  Box box = empty_box(), centroids = empty_box();
+  for (int k = first; k < first + count; k++) {
+    int i = b.items[k];
+    grow(box, s.boxes[i]);
+    Box c = { s.cx[i], s.cy[i], s.cx[i], s.cy[i] };
+    grow(centroids, c);
+  }
+  b.nodes[n].box = box;
+  b.nodes[n].index = first;
+  b.nodes[n].count = count;
+  if (count <= 1 || depth >= BVH_MAX_DEPTH)
+    return n;
+
+  // Binned SAH: the cheapest split between bins along either axis
+  float best_cost = INFINITY;
+  int best_axis = -1, best_split = 0;
+  for (int axis = 0; axis < 2; axis++) {
+    float lo = axis ? centroids.min_y : centroids.min_x;
+    float hi = axis ? centroids.max_y : centroids.max_x;
+    if (hi <= lo)
+      continue;
+    const std::vector<float>& c = axis ? s.cy : s.cx;
+    float scale = BVH_BINS / (hi - lo);
+    Box bins[BVH_BINS];
+    int counts[BVH_BINS] = { 0 };
+    for (int k = 0; k < BVH_BINS; k++)
+      bins[k] = empty_box();
+    for (int k = first; k < first + count; k++) {
+      int i = b.items[k];
+      int bin = std::min((int)((c[i] - lo) * scale), BVH_BINS - 1);
+      counts[bin]++;
+      grow(bins[bin], s.boxes[i]);
+    }
+    // Sweep from the right, then from the left
+    float right_area[BVH_BINS];
+    int right_count[BVH_BINS];
+    Box acc = empty_box();
+    int total = 0;
+    for (int k = BVH_BINS - 1; k > 0; k--) {
+      grow(acc, bins[k]);
+      total += counts[k];
+      right_area[k] = half_perimeter(acc);
+      right_count[k] = total;
+    }
+    acc = empty_box();
+    total = 0;
+    for (int k = 0; k < BVH_BINS - 1; k++) {
+      grow(acc, bins[k]);
+      total += counts[k];
+      if (total == 0 || right_count[k + 1] == 0)
+        continue;
+      float cost = half_perimeter(acc) * total + right_area[k + 1] * right_count[k + 1];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_split = k + 1;
+      }
+    }
+  }
+
+  // A leaf when no split pays for the extra node
+  float leaf_cost = half_perimeter(box) * count;
+  if (best_axis < 0 || (count <= BVH_MAX_LEAF &&
+                        BVH_TRAVERSAL_COST * half_perimeter(box) + best_cost >= leaf_cost))
+    return n;
+
+  float lo = best_axis ? centroids.min_y : centroids.min_x;
+  float hi = best_axis ? centroids.max_y : centroids.max_x;
+  const std::vector<float>& c = best_axis ? s.cy : s.cx;
+  float scale = BVH_BINS / (hi - lo);
+  int* middle = std::partition(&b.items[first], &b.items[first] + count, [&](int i) {
+    return std::min((int)((c[i] - lo) * scale), BVH_BINS - 1) < best_split;
+  });
+  int left = middle - &b.items[first];
+
+  b.nodes[n].count = 0;
+  build(b, s, first, left, depth + 1);
+  int right = build(b, s, first + left, count - left, depth + 1);
+  b.nodes[n].index = right;
+  return n;
+}
+
+void bvh_build (Bvh& b, const std::vector<Box>& boxes, float margin)
+{
+  b.margin = margin;
+  b.nodes.clear();
+  b.items.resize(boxes.size());
+  b.boxes.clear();
+  if (boxes.empty())
+    return;
+
+  BuildState s;
+  s.boxes.resize(boxes.size());
+  s.cx.resize(boxes.size());
+  s.cy.resize(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++) {
+    Box g = { boxes[i].min_x - margin, boxes[i].min_y - margin, boxes[i].max_x + margin, boxes[i].max_y + margin };
+    s.boxes[i] = g;
+    s.cx[i] = (g.min_x + g.max_x) * 0.5f;
+    s.cy[i] = (g.min_y + g.max_y) * 0.5f;
+    b.items[i] = i;
+  }
+  b.nodes.reserve(2 * boxes.size());
+  build(b, s, 0, boxes.size(), 0);
+  b.boxes.resize(boxes.size());
+  for (size_t k = 0; k < boxes.size(); k++)
+    b.boxes[k] = s.boxes[b.items[k]];
+}
@@ -0,0 +1,78 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cmath>
+#include <vector>
+
+#include "colliders.h"
+
+/* Bounding volume hierarchy over the boxes of static shapes, built once
+   with the surface area heuristic (perimeters in 2D) and stored depth
+   first in one array: the left child of a node comes right after it, so a
+   query walks memory mostly forwards. Queries cost about log n for levels
+   of any size and layout, where the grid suits shapes of similar size. */
+
+// Deeper nodes are made leaves, the query stack never overflows
+#define BVH_MAX_DEPTH 48
+
+struct BvhNode {
+  Box box;     // grown by the margin
+  int index;   // leaf: first item, inner node: right child
+  int count;   // items of a leaf, 0 for an inner node
+};
+
+struct Bvh {
+  float margin;                  // added on every side of a box
+  std::vector<BvhNode> nodes;    // nodes[0] is the root
+  std::vector<int> items;        // shape indices, each leaf's are contiguous
+  std::vector<Box> boxes;        // grown box of each item, in the same order
+};
+
+void bvh_build (Bvh& b, const std::vector<Box>& boxes, float margin);
+
+/* Does the segment from (x0, y0) by (dx, dy) touch the box? Separating
+   axes: both box axes and the normal of the segment. */
+inline bool segment_box (float x0, float y0, float dx, float dy, const Box& b)
+{
+  float x1 = x0 + dx, y1 = y0 + dy;
+  bool apart = ((x0 < x1 ? x0 : x1) > b.max_x) | ((x0 > x1 ? x0 : x1) < b.min_x) |
+               ((y0 < y1 ? y0 : y1) > b.max_y) | ((y0 > y1 ? y0 : y1) < b.min_y);
+  float hx = (b.max_x - b.min_x) * 0.5f, hy = (b.max_y - b.min_y) * 0.5f;
+  float d = dx * (b.min_y + hy - y0) - dy * (b.min_x + hx - x0);
+  return !apart && std::fabs(d) <= hx * std::fabs(dy) + hy * std::fabs(dx);
+}
+
+typedef void (*BvhVisit) (void* data, int item);
+
+/* visit(data, item) for every shape whose grown box the segment from
+   (x0, y0) to (x1, y1) touches */
+inline void bvh_segment (const Bvh& b, float x0, float y0, float x1, float y1, BvhVisit visit, void* data)
+{
+  if (b.nodes.empty())
+    return;
+  const BvhNode* nodes = &b.nodes[0];
+  const int* items = &b.items[0];
+  const Box* boxes = &b.boxes[0];
+  float dx = x1 - x0, dy = y1 - y0;
+  int stack[BVH_MAX_DEPTH + 1];
+  int top = 0;
+  int n = 0;
+  for (;;) {
+    const BvhNode& node = nodes[n];
+    if (segment_box(x0, y0, dx, dy, node.box)) {
+      if (node.count == 0) {
+        stack[top++] = node.index;
+        n++;
+        continue;
+      }
+      for (int k = node.index; k < node.index + node.count; k++)
+        if (segment_box(x0, y0, dx, dy, boxes[k]))
+          visit(data, items[k]);
+    }
+    if (top == 0)
+      break;
+    n = stack[--top];
+  }
+}
+
+#endif
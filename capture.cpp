@@ -0,0 +1,344 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "render.h"
+#include "soft_raster.h"
+#include "image_io.h"
+#include "capture.h"
+#include "trace.h"
+
+#define CAPTURE_PBOS 3
+#define CAPTURE_QUEUE 8
+
+struct CaptureFrame {
+  int number;
+  int width, height;
+  bool bottom_up;
+  std::vector<unsigned char> pixels;
+};
+
+static bool active = false;
+static CaptureFormat format;
+static bool realtime;
+static std::string target;
+static FILE* raw_output = NULL;
+static bool raw_stdout = false;   // kept after the shutdown, the stream is the frames' to the end
+static bool raw_is_pipe = false;
+
+static int width = 0, height = 0;
+static int frame_number = 0;
+static int dropped = 0;
+static std::vector<int> only_frames;
+
+// GL side: offscreen target and the readback ring
+static GLuint fbo = 0, color_rb = 0, depth_rb = 0;
+static GLuint pbos[CAPTURE_PBOS];
+static GLsync fences[CAPTURE_PBOS];
+static int pbo_frame[CAPTURE_PBOS];
+static int pbo_width[CAPTURE_PBOS], pbo_height[CAPTURE_PBOS];
+
+// Encoder thread
+static std::thread worker;
+static std::mutex queue_mutex;
+static std::condition_variable queue_ready, queue_space;
+static std::deque<CaptureFrame*> queue;
+static bool worker_exit = false;
+
+static void encode (CaptureFrame* frame)
+{
+  TraceScope trace("encode");
+  if (format == CAPTURE_PNG) {
+    std::vector<char> path(target.size() + 32);
+    snprintf(&path[0], path.size(), target.c_str(), frame->number);
+    if (!write_png(&path[0], frame->width, frame->height, &frame->pixels[0], frame->width, frame->bottom_up))
+      std::cerr << "capture: could not write " << &path[0] << '\n';
+  }
+  else if (!write_raw_rgba(raw_output, frame->width, frame->height, &frame->pixels[0], frame->width, frame->bottom_up))
+    std::cerr << "capture: write failed on frame " << frame->number << '\n';
+}
+
+static void worker_main ()
+{
+  trace_thread_name("capture");
+  for (;;) {
+    CaptureFrame* frame;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_ready.wait(lock, [] { return worker_exit || !queue.empty(); });
+      if (queue.empty())
+        return;
+      frame = queue.front();
+      queue.pop_front();
+    }
+    queue_space.notify_one();
+    encode(frame);
+    delete frame;
+  }
+}
+
+static void submit (CaptureFrame* frame)
+{
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if (queue.size() >= CAPTURE_QUEUE) {
+      if (realtime) {
+        dropped++;
+        delete frame;
+        return;
+      }
+      queue_space.wait(lock, [] { return queue.size() < CAPTURE_QUEUE; });
+    }
+    queue.push_back(frame);
+  }
+  queue_ready.notify_one();
+}
+
+/* Map a PBO whose readback was issued a few frames ago and hand it to the encoder */
+static void collect (int slot)
+{
+  if (pbo_frame[slot] < 0)
+    return;
+
+  // Should have signaled long ago, this only blocks when the GPU is far behind
+  glClientWaitSync(fences[slot], 0, (GLuint64)1000000000);
+  glDeleteSync(fences[slot]);
+
+  CaptureFrame* frame = new CaptureFrame;
+  frame->number = pbo_frame[slot];
+  frame->width = pbo_width[slot];
+  frame->height = pbo_height[slot];
+  frame->bottom_up = true;
+  size_t size = 4 * (size_t)frame->width * frame->height;
+  frame->pixels.resize(size);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+  void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+  if (data) {
+    memcpy(&frame->pixels[0], data, size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    submit(frame);
+  }
+  else
+    delete frame;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  pbo_frame[slot] = -1;
+}
+
+static void release_targets ()
+{
+  if (!fbo)
+    return;
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteRenderbuffers(1, &color_rb);
+  glDeleteRenderbuffers(1, &depth_rb);
+  fbo = color_rb = depth_rb = 0;
+}
+
+// The PNG target goes to snprintf: it has to hold exactly one integer
+// conversion with at most flags and a width of two digits, and %% for a
+// literal percent sign, or it would read arguments that are not there
+static bool png_pattern (const std::string& pattern)
+{
+  int numbers = 0;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    if (pattern[i] != '%')
+      continue;
+    if (++i < pattern.size() && pattern[i] == '%')
+      continue;
+    while (i < pattern.size() && strchr("-+ 0#", pattern[i]))
+      i++;
+    for (int digits = 0; i < pattern.size() && isdigit((unsigned char) pattern[i]); digits++, i++)
+      if (digits == 2)
+        return false;
+    if (i == pattern.size() || !strchr("diu", pattern[i]))
+      return false;
+    numbers++;
+  }
+  return numbers == 1;
+}
+
+bool capture_init (const char* path, CaptureFormat fmt, bool rt)
+{
+  target = path;
+  format = fmt;
+  realtime = rt;
+
+  if (format == CAPTURE_PNG && !png_pattern(target)) {
+    std::cerr << "capture: " << target << " needs one frame number like %05d and %% for a percent sign\n";
+    return false;
+  }
+  if (format == CAPTURE_RAW) {
+    if (target == "-") {
+      raw_output = stdout;
+      raw_stdout = true;
+    }
+    else if (target[0] == '|') {
+      raw_output = popen(target.c_str() + 1, "w");
+      raw_is_pipe = true;
+    }
+    else
+      raw_output = fopen(target.c_str(), "ab");
+    if (!raw_output) {
+      std::cerr << "capture: could not open " << target << '\n';
+      return false;
+    }
+  }
+
+  if (render_backend == BACKEND_GL) {
+    glGenBuffers(CAPTURE_PBOS, pbos);
+    for (int i = 0; i < CAPTURE_PBOS; i++)
+      pbo_frame[i] = -1;
+  }
+
+  worker_exit = false;
+  worker = std::thread(worker_main);
+  active = true;
+  return true;
+}
+
+void capture_only (const std::vector<int>& frames)
+{
+  only_frames = frames;
+}
+
+static bool wanted (int number)
+{
+  return only_frames.empty() || std::find(only_frames.begin(), only_frames.end(), number) != only_frames.end();
+}
+
+void capture_resize (int w, int h)
+{
+  if (!active || (w == width && h == height))
+    return;
+  width = w;
+  height = h;
+  if (render_backend != BACKEND_GL)
+    return;
+
+  release_targets();
+  glGenFramebuffers(1, &fbo);
+  glGenRenderbuffers(1, &color_rb);
+  glGenRenderbuffers(1, &depth_rb);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_rb);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rb);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rb);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "capture: incomplete framebuffer\n";
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // Size the ring for the new frame size, pending readbacks are collected first
+  for (int i = 0; i < CAPTURE_PBOS; i++) {
+    collect(i);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, 4 * (GLsizeiptr)width * height, NULL, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void capture_begin_frame ()
+{
+  if (active && fbo)
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void capture_end_frame ()
+{
+  if (!active)
+    return;
+
+  if (render_backend == BACKEND_SOFTWARE) {
+    if (!wanted(frame_number)) {
+      frame_number++;
+      return;
+    }
+    CaptureFrame* frame = new CaptureFrame;
+    frame->number = frame_number++;
+    frame->width = sr_width();
+    frame->height = sr_height();
+    frame->bottom_up = false;
+    frame->pixels.resize(4 * (size_t)frame->width * frame->height);
+    for (int y = 0; y < frame->height; y++)
+      memcpy(&frame->pixels[4 * (size_t)frame->width * y], sr_pixels() + (size_t)sr_stride() * y, 4 * frame->width);
+    submit(frame);
+    return;
+  }
+
+  if (!fbo)
+    return;
+
+  // Oldest slot first, then start an asynchronous readback into it
+  int slot = frame_number % CAPTURE_PBOS;
+  collect(slot);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  if (wanted(frame_number)) {
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pbo_frame[slot] = frame_number;
+    pbo_width[slot] = width;
+    pbo_height[slot] = height;
+  }
+  frame_number++;
+
+  // Still show the frame in the window
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void capture_shutdown ()
+{
+  if (!active)
+    return;
+  active = false;
+
+  if (render_backend == BACKEND_GL) {
+    for (int i = 0; i < CAPTURE_PBOS; i++)
+      collect((frame_number + i) % CAPTURE_PBOS);
+    glDeleteBuffers(CAPTURE_PBOS, pbos);
+    release_targets();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    worker_exit = true;
+  }
+  queue_ready.notify_one();
+  worker.join();
+
+  if (raw_output && raw_output != stdout) {
+    if (raw_is_pipe)
+      pclose(raw_output);
+    else
+      fclose(raw_output);
+  }
+  raw_output = NULL;
+  if (dropped)
+    std::cerr << "capture: dropped " << dropped << " frames\n";
+}
+
+bool capture_active ()
+{
+  return active;
+}
+
+bool capture_uses_stdout ()
+{
+  return raw_stdout;
+}
@@ -0,0 +1,28 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <vector>
+
+/* Frame capture: draw() renders into an FBO, the pixels come back through a
+   ring of pixel buffer objects a few frames later and a worker thread
+   encodes them, so the frame itself never waits on glReadPixels. */
+
+enum CaptureFormat {
+  CAPTURE_PNG,   // one file per frame, target is a printf pattern like "shots/frame_%05d.png"
+  CAPTURE_RAW    // RGBA appended to target, "-" is stdout and "|command" a pipe
+};
+
+/* realtime drops frames when the encoder falls behind instead of blocking */
+bool capture_init (const char* target, CaptureFormat format, bool realtime);
+/* Only capture these frame numbers, all of them when the list is empty */
+void capture_only (const std::vector<int>& frames);
+void capture_resize (int width, int height);
+void capture_begin_frame ();
+void capture_end_frame ();
+/* Reads back the frames still in flight and waits for the encoder */
+void capture_shutdown ();
+bool capture_active ();
+/* Raw frames go to stdout, which then has to carry nothing else */
+bool capture_uses_stdout ();
+
+#endif
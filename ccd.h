@@ -0,0 +1,82 @@
+#ifndef CCD_H
+#define CCD_H
+
+#include <cmath>
+
+#include "colliders.h"
+
+/* Continuous collision tests. A ball moves along the segment of one step,
+   from (x0, y0) by (dx, dy); the time of impact t is the fraction of that
+   segment travelled when it first touches, so fast balls cannot skip over
+   anything between two steps. */
+
+/* Against a circle at (cx, cy); radius is the sum of both radii */
+inline bool sweep_circle_circle (float x0, float y0, float dx, float dy, float cx, float cy, float radius, float* t)
+{
+  float mx = x0 - cx, my = y0 - cy;
+  float c = mx*mx + my*my - radius*radius;
+  float a = dx*dx + dy*dy, b = mx*dx + my*dy;
+  // Touching already at the start of the step: a hit only if closing in,
+  // one leaving the circle is already on its way out
+  if (c <= 0) {
+    *t = 0;
+    return b < 0;
+  }
+  // Not moving, or moving away
+  if (a == 0 || b >= 0)
+    return false;
+  float disc = b*b - a*c;
+  if (disc < 0)
+    return false;
+  float toi = (-b - std::sqrt(disc)) / a;
+  if (toi > 1)
+    return false;
+  *t = toi;
+  return true;
+}
+
+/* Against a convex polygon grown by radius: its edges pushed out along
+   their normals, joined by circles around its corners. (nx, ny) is the
+   normal at the contact. A ball already inside is only caught if it is
+   near a corner and moving towards it, circle_polygon_overlap() handles
+   the rest. */
+inline bool sweep_circle_polygon (float x0, float y0, float dx, float dy, const Polygon& p, float radius, float* t, float* nx, float* ny)
+{
+  bool found = false;
+  float best = 1;
+  for (int i = 0; i < p.count; i++) {
+    float ax = p.x[i], ay = p.y[i];
+    // Edge: crosses the pushed out line within the edge's length
+    float d0 = p.nx[i] * (x0 - ax) + p.ny[i] * (y0 - ay) - radius;
+    float dd = p.nx[i] * dx + p.ny[i] * dy;
+    if (d0 >= 0 && dd < 0 && d0 <= -dd * best) {
+      float toi = d0 / -dd;
+      int j = i + 1 == p.count ? 0 : i + 1;
+      float ex = p.x[j] - ax, ey = p.y[j] - ay;
+      float u = (x0 + toi * dx - ax) * ex + (y0 + toi * dy - ay) * ey;
+      if (u >= 0 && u <= ex*ex + ey*ey) {
+        best = toi;
+        *nx = p.nx[i];
+        *ny = p.ny[i];
+        found = true;
+      }
+    }
+    // Corner
+    float toi;
+    if (sweep_circle_circle(x0, y0, dx, dy, ax, ay, radius, &toi) && toi <= best) {
+      float cx = x0 + toi * dx - ax, cy = y0 + toi * dy - ay;
+      float length = std::sqrt(cx*cx + cy*cy);
+      if (length > 0) {
+        best = toi;
+        *nx = cx / length;
+        *ny = cy / length;
+        found = true;
+      }
+    }
+  }
+  if (found)
+    *t = best;
+  return found;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "colliders.h"
+
+struct Point {
+  float x, y;
+};
+
+static bool point_less (const Point& a, const Point& b)
+{
+  return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+static float cross (const Point& o, const Point& a, const Point& b)
+{
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+bool polygon_from_vertices (const float* xyz, int vertices, float ox, float oy, Polygon& out)
+{
+  int n = std::max(vertices, 0);
+  std::vector<Point> points(n);
+  for (int i = 0; i < n; i++) {
+    points[i].x = xyz[3*i] + ox;
+    points[i].y = xyz[3*i + 1] + oy;
+  }
+  std::sort(points.begin(), points.end(), point_less);
+
+  // Monotone chain, collinear and repeated points dropped
+  std::vector<Point> hull(2 * n + 1);
+  int k = 0;
+  for (int i = 0; i < n; i++) {
+    while (k >= 2 && cross(hull[k-2], hull[k-1], points[i]) <= 0)
+      k--;
+    hull[k++] = points[i];
+  }
+  for (int i = n - 2, lower = k + 1; i >= 0; i--) {
+    while (k >= lower && cross(hull[k-2], hull[k-1], points[i]) <= 0)
+      k--;
+    hull[k++] = points[i];
+  }
+  k--;   // the last point is the first one again
+  if (k < 3 || k > MAX_POLYGON_VERTICES)
+    return false;
+
+  out.count = k;
+  out.box.min_x = out.box.min_y = INFINITY;
+  out.box.max_x = out.box.max_y = -INFINITY;
+  for (int i = 0; i < k; i++) {
+    const Point& a = hull[i];
+    const Point& b = hull[(i + 1) % k];
+    out.x[i] = a.x;
+    out.y[i] = a.y;
+    // Counter-clockwise, so the outside is on the right of each edge
+    float ex = b.x - a.x, ey = b.y - a.y, length = std::sqrt(ex*ex + ey*ey);
+    out.nx[i] = ey / length;
+    out.ny[i] = -ex / length;
+    out.box.min_x = std::min(out.box.min_x, a.x);
+    out.box.min_y = std::min(out.box.min_y, a.y);
+    out.box.max_x = std::max(out.box.max_x, a.x);
+    out.box.max_y = std::max(out.box.max_y, a.y);
+  }
+  return true;
+}
+
+bool circle_polygon_overlap (const Polygon& p, float x, float y, float radius, float* nx, float* ny, float* depth)
+{
+  // Separating axes of the edges: the largest separation decides
+  int best = 0;
+  float separation = -INFINITY;
+  for (int i = 0; i < p.count; i++) {
+    float s = p.nx[i] * (x - p.x[i]) + p.ny[i] * (y - p.y[i]);
+    if (s > radius)
+      return false;
+    if (s > separation) {
+      separation = s;
+      best = i;
+    }
+  }
+
+  // Center inside: out through the nearest edge
+  if (separation <= 0) {
+    *nx = p.nx[best];
+    *ny = p.ny[best];
+    *depth = radius - separation;
+    return true;
+  }
+
+  // Center outside: the closest point of the boundary, which may be a corner
+  float closest = INFINITY, qx = 0, qy = 0;
+  for (int i = 0; i < p.count; i++) {
+    int j = (i + 1) % p.count;
+    float ex = p.x[j] - p.x[i], ey = p.y[j] - p.y[i];
+    float u = ((x - p.x[i]) * ex + (y - p.y[i]) * ey) / (ex*ex + ey*ey);
+    u = std::min(std::max(u, 0.0f), 1.0f);
+    float cx = p.x[i] + u * ex, cy = p.y[i] + u * ey;
+    float d2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+    if (d2 < closest) {
+      closest = d2;
+      qx = cx;
+      qy = cy;
+    }
+  }
+  if (closest > radius * radius)
+    return false;
+  float d = std::sqrt(closest);
+  *nx = (x - qx) / d;
+  *ny = (y - qy) / d;
+  *depth = radius - d;
+  return true;
+}
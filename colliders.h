@@ -0,0 +1,39 @@
+#ifndef COLLIDERS_H
+#define COLLIDERS_H
+
+/* Static collision shapes, in level coordinates */
+
+struct Box {
+  float min_x, min_y, max_x, max_y;
+};
+
+struct Target {
+  float x, y, radius;
+};
+
+inline Box target_box (const Target& t)
+{
+  Box b = { t.x - t.radius, t.y - t.radius, t.x + t.radius, t.y + t.radius };
+  return b;
+}
+
+#define MAX_POLYGON_VERTICES 8
+
+/* Convex polygon, counter-clockwise */
+struct Polygon {
+  int count;
+  float x[MAX_POLYGON_VERTICES], y[MAX_POLYGON_VERTICES];
+  float nx[MAX_POLYGON_VERTICES], ny[MAX_POLYGON_VERTICES];   // outward normal of the edge from vertex i to i + 1
+  Box box;
+};
+
+/* Convex hull of the xyz vertices of a mesh (z is ignored) moved by
+   (ox, oy), so a collider can be made from the data a VAO is built from.
+   False if the hull has more than MAX_POLYGON_VERTICES corners. */
+bool polygon_from_vertices (const float* xyz, int vertices, float ox, float oy, Polygon& out);
+
+/* Closest point test of a circle against a polygon. On overlap gives the
+   direction (nx, ny) and the depth to push the circle out along. */
+bool circle_polygon_overlap (const Polygon& p, float x, float y, float radius, float* nx, float* ny, float* depth);
+
+#endif
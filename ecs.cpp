@@ -0,0 +1,232 @@
+#include <cmath>
+#include <cstddef>
+
+#include "ecs.h"
+
+static Archetype* archetype (World& w, unsigned int mask, int* index)
+{
+  for (size_t i = 0; i < w.archetypes.size(); i++) {
+    if (w.archetypes[i]->mask == mask) {
+      *index = i;
+      return w.archetypes[i];
+    }
+  }
+  Archetype* a = new Archetype;
+  a->mask = mask;
+  a->count = 0;
+  *index = w.archetypes.size();
+  w.archetypes.push_back(a);
+  return a;
+}
+
+Entity world_create (World& w, unsigned int mask)
+{
+  int index;
+  Archetype* a = archetype(w, mask, &index);
+  Entity e;
+  if (w.free_entities.empty()) {
+    e = w.archetype_of.size();
+    w.archetype_of.push_back(-1);
+    w.row_of.push_back(-1);
+  }
+  else {
+    e = w.free_entities.back();
+    w.free_entities.pop_back();
+  }
+
+  int row = a->count++;
+  a->entity.push_back(e);
+  if (mask & COMPONENT_TRANSFORM) {
+    Affine identity = { { 1, 0, 0, 1, 0, 0 } };
+    a->x.push_back(0);
+    a->y.push_back(0);
+    a->rotation.push_back(0);
+    a->scale.push_back(1);
+    a->parent.push_back(NO_ENTITY);
+    a->first_child.push_back(NO_ENTITY);
+    a->next_sibling.push_back(NO_ENTITY);
+    a->world.push_back(identity);
+    a->dirty.push_back(1);
+    a->moved.push_back(1);
+  }
+  if (mask & COMPONENT_RENDERABLE) {
+    a->vao.push_back(NULL);
+    a->mvp.push_back(Matrix());
+  }
+  if (mask & COMPONENT_COLLIDER)
+    a->collider.push_back(Polygon());
+  if (mask & COMPONENT_TARGET) {
+    a->target.push_back(-1);
+    a->hit.push_back(0);
+  }
+  w.archetype_of[e] = index;
+  w.row_of[e] = row;
+  return e;
+}
+
+/* Moves the last row into 'row' and drops the last one */
+template <typename T>
+static void remove_row (std::vector<T>& v, int row)
+{
+  if (v.empty())
+    return;
+  v[row] = v.back();
+  v.pop_back();
+}
+
+void world_destroy (World& w, Entity e)
+{
+  EntityRef r = world_get(w, e);
+  if (!r.a)
+    return;
+  // Children stay where they are in the level
+  if (r.a->mask & COMPONENT_TRANSFORM) {
+    transform_attach(w, e, NO_ENTITY);
+    while (r.a->first_child[r.row] != NO_ENTITY) {
+      Entity child = r.a->first_child[r.row];
+      EntityRef c = world_get(w, child);
+      const Affine& m = c.a->world[c.row];
+      float scale = std::sqrt(m.m[0] * m.m[0] + m.m[1] * m.m[1]);
+      transform_attach(w, child, NO_ENTITY);
+      transform_set(w, child, m.m[4], m.m[5], std::atan2(m.m[1], m.m[0]) * 180 / M_PI, scale);
+    }
+  }
+  Archetype& a = *r.a;
+  int last = --a.count;
+  w.row_of[a.entity[last]] = r.row;
+  remove_row(a.entity, r.row);
+  remove_row(a.x, r.row);
+  remove_row(a.y, r.row);
+  remove_row(a.rotation, r.row);
+  remove_row(a.scale, r.row);
+  remove_row(a.parent, r.row);
+  remove_row(a.first_child, r.row);
+  remove_row(a.next_sibling, r.row);
+  remove_row(a.world, r.row);
+  remove_row(a.dirty, r.row);
+  remove_row(a.moved, r.row);
+  remove_row(a.vao, r.row);
+  remove_row(a.mvp, r.row);
+  remove_row(a.collider, r.row);
+  remove_row(a.target, r.row);
+  remove_row(a.hit, r.row);
+  w.archetype_of[e] = -1;
+  w.row_of[e] = -1;
+  w.free_entities.push_back(e);
+}
+
+void world_clear (World& w)
+{
+  for (size_t i = 0; i < w.archetypes.size(); i++)
+    delete w.archetypes[i];
+  w.archetypes.clear();
+  w.archetype_of.clear();
+  w.row_of.clear();
+  w.free_entities.clear();
+}
+
+EntityRef world_get (const World& w, Entity e)
+{
+  EntityRef r = { NULL, -1 };
+  if (e < w.archetype_of.size() && w.archetype_of[e] >= 0) {
+    r.a = w.archetypes[w.archetype_of[e]];
+    r.row = w.row_of[e];
+  }
+  return r;
+}
+
+/* Marks e and everything below it */
+static void mark_dirty (World& w, Entity e)
+{
+  EntityRef r = world_get(w, e);
+  if (r.a->dirty[r.row])
+    return;   // its subtree is marked already
+  r.a->dirty[r.row] = 1;
+  for (Entity c = r.a->first_child[r.row]; c != NO_ENTITY; ) {
+    mark_dirty(w, c);
+    EntityRef cr = world_get(w, c);
+    c = cr.a->next_sibling[cr.row];
+  }
+}
+
+void transform_attach (World& w, Entity child, Entity parent)
+{
+  EntityRef r = world_get(w, child);
+  Entity old = r.a->parent[r.row];
+  if (old != NO_ENTITY) {
+    // Unlink from the old parent's list of children
+    EntityRef p = world_get(w, old);
+    Entity* link = &p.a->first_child[p.row];
+    while (*link != child) {
+      EntityRef s = world_get(w, *link);
+      link = &s.a->next_sibling[s.row];
+    }
+    *link = r.a->next_sibling[r.row];
+  }
+  r.a->parent[r.row] = parent;
+  r.a->next_sibling[r.row] = NO_ENTITY;
+  if (parent != NO_ENTITY) {
+    EntityRef p = world_get(w, parent);
+    r.a->next_sibling[r.row] = p.a->first_child[p.row];
+    p.a->first_child[p.row] = child;
+  }
+  r.a->dirty[r.row] = 0;
+  mark_dirty(w, child);
+}
+
+void transform_set (World& w, Entity e, float x, float y, float rotation, float scale)
+{
+  EntityRef r = world_get(w, e);
+  Archetype& a = *r.a;
+  int i = r.row;
+  if (a.x[i] == x && a.y[i] == y && a.rotation[i] == rotation && a.scale[i] == scale)
+    return;
+  a.x[i] = x;
+  a.y[i] = y;
+  a.rotation[i] = rotation;
+  a.scale[i] = scale;
+  mark_dirty(w, e);
+}
+
+/* World transform of one row, its parent brought up to date first */
+static int update_row (World& w, Archetype& a, int i)
+{
+  int updated = 1;
+  float angle = a.rotation[i] * M_PI / 180.0f;
+  float c = std::cos(angle) * a.scale[i], s = std::sin(angle) * a.scale[i];
+  Affine local = { { c, s, -s, c, a.x[i], a.y[i] } };
+  Affine& m = a.world[i];
+  if (a.parent[i] == NO_ENTITY)
+    m = local;
+  else {
+    EntityRef p = world_get(w, a.parent[i]);
+    if (p.a->dirty[p.row])
+      updated += update_row(w, *p.a, p.row);
+    const float* q = p.a->world[p.row].m;
+    const float* l = local.m;
+    m.m[0] = q[0] * l[0] + q[2] * l[1];
+    m.m[1] = q[1] * l[0] + q[3] * l[1];
+    m.m[2] = q[0] * l[2] + q[2] * l[3];
+    m.m[3] = q[1] * l[2] + q[3] * l[3];
+    m.m[4] = q[0] * l[4] + q[2] * l[5] + q[4];
+    m.m[5] = q[1] * l[4] + q[3] * l[5] + q[5];
+  }
+  a.dirty[i] = 0;
+  a.moved[i] = 1;
+  return updated;
+}
+
+int transform_update (World& w)
+{
+  int updated = 0;
+  for (size_t k = 0; k < w.archetypes.size(); k++) {
+    Archetype& a = *w.archetypes[k];
+    if (!(a.mask & COMPONENT_TRANSFORM))
+      continue;
+    for (int i = 0; i < a.count; i++) {
+      if (a.dirty[i])
+        updated += update_row(w, a, i);
+    }
+  }
+  return updated;
+}
@@ -0,0 +1,90 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <vector>
+
+#include "colliders.h"
+
+struct VAO;
+
+/* Entities of the scene, stored by archetype: every entity with the same
+   set of components lives in one Archetype, each component field in an
+   array of its own, so a system walks contiguous arrays of only the
+   fields it needs. Removing an entity moves the last one of its archetype
+   into its row. Archetypes keep the order they were first used in, rows
+   the order their entities were made in until one is removed: that is
+   the draw order. */
+
+enum {
+  COMPONENT_TRANSFORM = 1,    // placement relative to a parent, or the level
+  COMPONENT_RENDERABLE = 2,   // a mesh, NULL until it is uploaded
+  COMPONENT_COLLIDER = 4,     // a convex polygon balls bounce off
+  COMPONENT_TARGET = 8        // a target of the simulation
+};
+
+typedef unsigned int Entity;
+#define NO_ENTITY 0xffffffffu
+
+/* 2D affine transform, x' = m[0] x + m[2] y + m[4], y' = m[1] x + m[3] y + m[5] */
+struct Affine {
+  float m[6];
+};
+
+/* Column major, as GL takes it */
+struct Matrix {
+  float m[16];
+};
+
+struct Archetype {
+  unsigned int mask;
+  int count;
+  std::vector<Entity> entity;
+  // COMPONENT_TRANSFORM: parent * translate(x, y) * rotate(rotation) * scale.
+  // The world transform is cached and only recomputed for rows marked
+  // dirty, which marks their whole subtree.
+  std::vector<float> x, y;
+  std::vector<float> rotation;            // degrees
+  std::vector<float> scale;
+  std::vector<Entity> parent, first_child, next_sibling;
+  std::vector<Affine> world;
+  std::vector<unsigned char> dirty;
+  std::vector<unsigned char> moved;       // world changed since the renderer last looked
+  // COMPONENT_RENDERABLE
+  std::vector<VAO*> vao;
+  std::vector<Matrix> mvp;                // cached by the renderer
+  // COMPONENT_COLLIDER
+  std::vector<Polygon> collider;
+  // COMPONENT_TARGET
+  std::vector<int> target;                // index in the simulation's targets
+  std::vector<unsigned char> hit;
+};
+
+struct World {
+  std::vector<Archetype*> archetypes;
+  std::vector<int> archetype_of;   // per entity, -1 when free
+  std::vector<int> row_of;
+  std::vector<Entity> free_entities;
+};
+
+/* Row of an entity in its archetype */
+struct EntityRef {
+  Archetype* a;
+  int row;
+};
+
+/* A new entity with the components of 'mask', at the origin and scale 1 */
+Entity world_create (World& w, unsigned int mask);
+void world_destroy (World& w, Entity e);
+void world_clear (World& w);
+/* a is NULL for an entity that does not exist */
+EntityRef world_get (const World& w, Entity e);
+
+/* Makes child move with parent, NO_ENTITY detaches it */
+void transform_attach (World& w, Entity child, Entity parent);
+/* Sets the local transform, marking it dirty only if it changed */
+void transform_set (World& w, Entity e, float x, float y, float rotation, float scale=1);
+/* Recomputes the world transform of every dirty entity, parents first.
+   Returns how many were recomputed. */
+int transform_update (World& w);
+
+#endif
@@ -0,0 +1,329 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+#include "image_io.h"
+
+/* Golden image regression tests.
+   Every scene of the manifest is rendered by the game with the software
+   backend (no GPU needed), stepped deterministically to the listed frames
+   and compared against golden/<scene>_<frame>.png. Scenes run in parallel,
+   one game process per core. */
+
+struct Scene {
+  std::string name;
+  std::vector<int> frames;
+  std::vector<std::string> args;
+};
+
+struct FrameResult {
+  int frame;
+  bool passed;
+  double ssim;
+  int bad_pixels;
+  std::string message;
+};
+
+struct SceneResult {
+  bool passed;
+  std::string message;
+  std::vector<FrameResult> frames;
+};
+
+struct Settings {
+  std::string game;
+  std::string manifest;
+  std::string golden;
+  std::string out;
+  std::string size;
+  int jobs;
+  bool update;
+  int tolerance;        // per channel difference that still counts as equal
+  double max_bad;       // fraction of pixels allowed above tolerance
+  double min_ssim;
+} settings = { "./sample2D", "golden/scenes.txt", "golden", "golden_out", "320x180", 0, false, 8, 0.001, 0.98 };
+
+static std::vector<Scene> loadManifest (const std::string& path)
+{
+  std::vector<Scene> scenes;
+  std::ifstream in(path.c_str());
+  if (!in.is_open()) {
+    std::cerr << "Could not open " << path << '\n';
+    exit(EXIT_FAILURE);
+  }
+  std::string line;
+  while (getline(in, line)) {
+    std::istringstream words(line);
+    Scene scene;
+    std::string frames, arg;
+    if (!(words >> scene.name) || scene.name[0] == '#')
+      continue;
+    words >> frames;
+    for (const char* p = frames.c_str(); *p; ) {
+      char* end;
+      scene.frames.push_back(strtol(p, &end, 10));
+      p = *end ? end + 1 : end;
+    }
+    while (words >> arg)
+      scene.args.push_back(arg);
+    scenes.push_back(scene);
+  }
+  return scenes;
+}
+
+static std::string framePath (const std::string& dir, const std::string& name, int frame, const char* suffix="")
+{
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "_%05d%s.png", frame, suffix);
+  return dir + "/" + name + buffer;
+}
+
+/* Run the game for one scene, output goes to <out>/<scene>.log */
+static bool renderScene (const Scene& scene, std::string& message)
+{
+  int last = 0;
+  for (size_t i = 0; i < scene.frames.size(); i++)
+    last = std::max(last, scene.frames[i]);
+
+  std::ostringstream frames, last_frame;
+  for (size_t i = 0; i < scene.frames.size(); i++)
+    frames << (i ? "," : "") << scene.frames[i];
+  last_frame << last + 1;
+  std::string capture = settings.out + "/" + scene.name + "_%05d.png";
+
+  std::vector<std::string> args;
+  args.push_back(settings.game);
+  args.push_back("--software");
+  // Parallelism comes from running several scenes at once
+  args.push_back("--threads");
+  args.push_back("1");
+  args.push_back("--size");
+  args.push_back(settings.size);
+  args.push_back("--frames");
+  args.push_back(last_frame.str());
+  args.push_back("--capture-frames");
+  args.push_back(frames.str());
+  args.push_back("--capture");
+  args.push_back(capture);
+  args.insert(args.end(), scene.args.begin(), scene.args.end());
+
+  std::vector<char*> argv;
+  for (size_t i = 0; i < args.size(); i++)
+    argv.push_back(const_cast<char*>(args[i].c_str()));
+  argv.push_back(NULL);
+
+  std::string log = settings.out + "/" + scene.name + ".log";
+  pid_t pid = fork();
+  if (pid == 0) {
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+      dup2(fd, 1);
+      dup2(fd, 2);
+      close(fd);
+    }
+    execv(argv[0], &argv[0]);
+    perror("execv");
+    _exit(127);
+  }
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    message = "game failed, see " + log;
+    return false;
+  }
+  return true;
+}
+
+static double luma (const unsigned char* p)
+{
+  return 0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2];
+}
+
+/* Mean SSIM of the luma over 8x8 windows with a stride of 4 */
+static double ssim (const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, int width, int height)
+{
+  const double c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+  double total = 0;
+  int windows = 0;
+  for (int y0 = 0; y0 + 8 <= height; y0 += 4) {
+    for (int x0 = 0; x0 + 8 <= width; x0 += 4) {
+      double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+      for (int y = y0; y < y0 + 8; y++) {
+        for (int x = x0; x < x0 + 8; x++) {
+          double la = luma(&a[4 * ((size_t)width * y + x)]);
+          double lb = luma(&b[4 * ((size_t)width * y + x)]);
+          sa += la;
+          sb += lb;
+          saa += la * la;
+          sbb += lb * lb;
+          sab += la * lb;
+        }
+      }
+      double ma = sa / 64, mb = sb / 64;
+      double va = saa / 64 - ma * ma, vb = sbb / 64 - mb * mb, cov = sab / 64 - ma * mb;
+      total += ((2 * ma * mb + c1) * (2 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+      windows++;
+    }
+  }
+  return windows ? total / windows : 1.0;
+}
+
+static FrameResult compareFrame (const Scene& scene, int frame)
+{
+  FrameResult result;
+  result.frame = frame;
+  result.passed = false;
+  result.ssim = 0;
+  result.bad_pixels = 0;
+
+  std::string actual_path = framePath(settings.out, scene.name, frame);
+  std::string golden_path = framePath(settings.golden, scene.name, frame);
+  int aw, ah, gw, gh;
+  std::vector<unsigned char> actual, golden;
+  if (!read_png(actual_path.c_str(), &aw, &ah, actual)) {
+    result.message = "no output " + actual_path;
+    return result;
+  }
+
+  if (settings.update) {
+    result.passed = write_png(golden_path.c_str(), aw, ah, &actual[0], aw, false);
+    result.ssim = 1;
+    result.message = result.passed ? "updated" : "could not write " + golden_path;
+    return result;
+  }
+
+  if (!read_png(golden_path.c_str(), &gw, &gh, golden)) {
+    result.message = "no golden image " + golden_path;
+    return result;
+  }
+  if (aw != gw || ah != gh) {
+    result.message = "size mismatch";
+    return result;
+  }
+
+  // Red where a channel is off by more than the tolerance, dimmed golden elsewhere
+  std::vector<unsigned char> diff(actual.size());
+  for (size_t i = 0; i < actual.size(); i += 4) {
+    int worst = 0;
+    for (int c = 0; c < 3; c++)
+      worst = std::max(worst, std::abs((int)actual[i+c] - (int)golden[i+c]));
+    bool bad = worst > settings.tolerance;
+    result.bad_pixels += bad;
+    unsigned char dim = (unsigned char)(luma(&golden[i]) / 3);
+    diff[i] = bad ? 255 : dim;
+    diff[i+1] = bad ? 0 : dim;
+    diff[i+2] = bad ? 0 : dim;
+    diff[i+3] = 255;
+  }
+  result.ssim = ssim(actual, golden, aw, ah);
+  result.passed = result.bad_pixels <= settings.max_bad * aw * ah && result.ssim >= settings.min_ssim;
+  if (!result.passed) {
+    std::string diff_path = framePath(settings.out, scene.name, frame, "_diff");
+    write_png(diff_path.c_str(), aw, ah, &diff[0], aw, false);
+    result.message = "diff in " + diff_path;
+  }
+  return result;
+}
+
+static SceneResult runScene (const Scene& scene)
+{
+  SceneResult result;
+  result.passed = renderScene(scene, result.message);
+  if (!result.passed)
+    return result;
+  for (size_t i = 0; i < scene.frames.size(); i++) {
+    result.frames.push_back(compareFrame(scene, scene.frames[i]));
+    result.passed = result.passed && result.frames.back().passed;
+  }
+  return result;
+}
+
+static void usage ()
+{
+  std::cerr << "usage: golden_test [--game path] [--manifest file] [--golden dir] [--out dir] [--size WxH]\n"
+               "                   [-j jobs] [--tolerance n] [--max-bad fraction] [--min-ssim value] [--update] [scene...]\n";
+  exit(EXIT_FAILURE);
+}
+
+int main (int argc, char** argv)
+{
+  std::vector<std::string> only;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--game" && has_value)
+      settings.game = argv[++i];
+    else if (arg == "--manifest" && has_value)
+      settings.manifest = argv[++i];
+    else if (arg == "--golden" && has_value)
+      settings.golden = argv[++i];
+    else if (arg == "--out" && has_value)
+      settings.out = argv[++i];
+    else if (arg == "--size" && has_value)
+      settings.size = argv[++i];
+    else if (arg == "-j" && has_value)
+      settings.jobs = atoi(argv[++i]);
+    else if (arg == "--tolerance" && has_value)
+      settings.tolerance = atoi(argv[++i]);
+    else if (arg == "--max-bad" && has_value)
+      settings.max_bad = atof(argv[++i]);
+    else if (arg == "--min-ssim" && has_value)
+      settings.min_ssim = atof(argv[++i]);
+    else if (arg == "--update")
+      settings.update = true;
+    else if (arg[0] == '-')
+      usage();
+    else
+      only.push_back(arg);
+  }
+
+  std::vector<Scene> scenes, manifest = loadManifest(settings.manifest);
+  for (size_t i = 0; i < manifest.size(); i++)
+    if (only.empty() || std::find(only.begin(), only.end(), manifest[i].name) != only.end())
+      scenes.push_back(manifest[i]);
+
+  mkdir(settings.out.c_str(), 0755);
+  if (settings.jobs <= 0)
+    settings.jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<SceneResult> results(scenes.size());
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (int j = 0; j < settings.jobs; j++) {
+    workers.push_back(std::thread([&] {
+      for (size_t i = next++; i < scenes.size(); i = next++)
+        results[i] = runScene(scenes[i]);
+    }));
+  }
+  for (size_t j = 0; j < workers.size(); j++)
+    workers[j].join();
+
+  int passed = 0;
+  for (size_t i = 0; i < scenes.size(); i++) {
+    const SceneResult& r = results[i];
+    passed += r.passed;
+    std::cout << (r.passed ? "PASS " : "FAIL ") << scenes[i].name;
+    if (!r.message.empty())
+      std::cout << "  " << r.message;
+    std::cout << '\n';
+    for (size_t f = 0; f < r.frames.size(); f++) {
+      const FrameResult& fr = r.frames[f];
+      printf("    frame %5d  ssim %.4f  bad %6d  %s\n", fr.frame, fr.ssim, fr.bad_pixels, fr.message.c_str());
+    }
+  }
+  std::cout << passed << '/' << scenes.size() << " scenes passed\n";
+  return passed == (int)scenes.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
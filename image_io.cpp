@@ -0,0 +1,501 @@
+#include <cstring>
+#include <vector>
+
+#include "image_io.h"
+
+/* CRC-32 as used by PNG chunks */
+struct CrcTable {
+  unsigned int entries[256];
+  CrcTable () {
+    for (unsigned int n = 0; n < 256; n++) {
+      unsigned int c = n;
+      for (int k = 0; k < 8; k++)
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      entries[n] = c;
+    }
+  }
+};
+static const CrcTable crc_table;
+
+static unsigned int crc32_update (unsigned int crc, const unsigned char* data, size_t length)
+{
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++)
+    crc = crc_table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+static unsigned int adler32 (const std::vector<unsigned char>& data)
+{
+  // Reduced every 5552 bytes which is the most that cannot overflow
+  unsigned int a = 1, b = 0;
+  for (size_t i = 0; i < data.size(); ) {
+    size_t end = i + 5552 < data.size() ? i + 5552 : data.size();
+    for (; i < end; i++) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return (b << 16) | a;
+}
+
+static void put_be32 (std::vector<unsigned char>& out, unsigned int v)
+{
+  out.push_back(v >> 24);
+  out.push_back(v >> 16);
+  out.push_back(v >> 8);
+  out.push_back(v);
+}
+
+static unsigned int get_be32 (const unsigned char* p)
+{
+  return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+/**********
+ * Deflate
+ **********/
+
+static const unsigned short length_base[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char length_extra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short dist_base[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char dist_extra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+struct BitWriter {
+  std::vector<unsigned char>& out;
+  unsigned int buffer;
+  int count;
+
+  BitWriter (std::vector<unsigned char>& o) : out(o), buffer(0), count(0) {}
+
+  void bits (unsigned int value, int n) {
+    buffer |= value << count;
+    count += n;
+    while (count >= 8) {
+      out.push_back(buffer & 0xff);
+      buffer >>= 8;
+      count -= 8;
+    }
+  }
+  // Huffman codes go out most significant bit first
+  void code (unsigned int value, int n) {
+    unsigned int reversed = 0;
+    for (int i = 0; i < n; i++)
+      reversed |= ((value >> i) & 1) << (n - 1 - i);
+    bits(reversed, n);
+  }
+  void flush () {
+    if (count > 0)
+      out.push_back(buffer & 0xff);
+    buffer = 0;
+    count = 0;
+  }
+};
+
+static void fixed_literal (BitWriter& w, int symbol)
+{
+  if (symbol < 144)
+    w.code(0x30 + symbol, 8);
+  else if (symbol < 256)
+    w.code(0x190 + symbol - 144, 9);
+  else if (symbol < 280)
+    w.code(symbol - 256, 7);
+  else
+    w.code(0xc0 + symbol - 280, 8);
+}
+
+/* One fixed Huffman block with greedy LZ77 matching. Rendered frames are
+   mostly flat colors, which this already shrinks by two orders of magnitude. */
+static void deflate (const std::vector<unsigned char>& in, std::vector<unsigned char>& out)
+{
+  const int hash_bits = 15, window = 32768;
+  std::vector<int> head(1 << hash_bits, -1);
+  BitWriter w(out);
+  w.bits(1, 1);  // final block
+  w.bits(1, 2);  // fixed Huffman codes
+
+  size_t n = in.size(), i = 0;
+  while (i < n) {
+    int best_length = 0, best_distance = 0;
+    if (i + 3 <= n) {
+      unsigned int h = ((in[i] << 10) ^ (in[i+1] << 5) ^ in[i+2]) & ((1 << hash_bits) - 1);
+      int candidate = head[h];
+      head[h] = (int)i;
+      if (candidate >= 0 && (int)i - candidate <= window) {
+        size_t limit = n - i < 258 ? n - i : 258;
+        size_t length = 0;
+        while (length < limit && in[candidate + length] == in[i + length])
+          length++;
+        if (length >= 3) {
+          best_length = (int)length;
+          best_distance = (int)i - candidate;
+        }
+      }
+    }
+
+    if (best_length == 0) {
+      fixed_literal(w, in[i++]);
+      continue;
+    }
+
+    int l = 28;
+    while (length_base[l] > best_length)
+      l--;
+    fixed_literal(w, 257 + l);
+    w.bits(best_length - length_base[l], length_extra[l]);
+    int d = 29;
+    while (dist_base[d] > best_distance)
+      d--;
+    w.code(d, 5);
+    w.bits(best_distance - dist_base[d], dist_extra[d]);
+
+    // Keep the hash chain warm over the matched bytes
+    for (size_t k = i + 1; k < i + best_length && k + 3 <= n; k++)
+      head[((in[k] << 10) ^ (in[k+1] << 5) ^ in[k+2]) & ((1 << hash_bits) - 1)] = (int)k;
+    i += best_length;
+  }
+  fixed_literal(w, 256);
+  w.flush();
+}
+
+/**********
+ * Inflate
+ **********/
+
+struct BitReader {
+  const unsigned char* data;
+  size_t size, pos;
+  unsigned int buffer;
+  int count;
+  bool error;
+
+  int bits (int n) {
+    while (count < n) {
+      if (pos >= size) {
+        error = true;
+        return 0;
+      }
+      buffer |= (unsigned int)data[pos++] << count;
+      count += 8;
+    }
+    int value = buffer & ((1u << n) - 1);
+    buffer >>= n;
+    count -= n;
+    return value;
+  }
+};
+
+/* Canonical Huffman decoding table, counts per code length and symbols by code */
+struct Huffman {
+  short counts[16];
+  short symbols[288];
+
+  bool build (const unsigned char* lengths, int n) {
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < n; i++)
+      counts[lengths[i]]++;
+    counts[0] = 0;
+    short offsets[16];
+    offsets[1] = 0;
+    for (int i = 1; i < 15; i++)
+      offsets[i+1] = offsets[i] + counts[i];
+    for (int i = 0; i < n; i++)
+      if (lengths[i])
+        symbols[offsets[lengths[i]]++] = i;
+    return true;
+  }
+
+  int decode (BitReader& r) const {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+      code |= r.bits(1);
+      int count = counts[len];
+      if (code - first < count)
+        return symbols[index + code - first];
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+    r.error = true;
+    return -1;
+  }
+};
+
+static bool inflate_codes (BitReader& r, const Huffman& lit, const Huffman& dist, std::vector<unsigned char>& out)
+{
+  for (;;) {
+    int symbol = lit.decode(r);
+    if (r.error || symbol < 0)
+      return false;
+    if (symbol < 256)
+      out.push_back(symbol);
+    else if (symbol == 256)
+      return true;
+    else {
+      symbol -= 257;
+      if (symbol >= 29)
+        return false;
+      int length = length_base[symbol] + r.bits(length_extra[symbol]);
+      int d = dist.decode(r);
+      if (d < 0 || d >= 30)
+        return false;
+      size_t distance = dist_base[d] + r.bits(dist_extra[d]);
+      if (r.error || distance > out.size())
+        return false;
+      size_t from = out.size() - distance;
+      for (int k = 0; k < length; k++)
+        out.push_back(out[from + k]);
+    }
+  }
+}
+
+static bool inflate (const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+{
+  BitReader r = { data, size, 0, 0, 0, false };
+  int final;
+  do {
+    final = r.bits(1);
+    int type = r.bits(2);
+    if (type == 0) {
+      r.buffer = 0;
+      r.count = 0;
+      if (r.pos + 4 > size)
+        return false;
+      unsigned int length = data[r.pos] | (data[r.pos+1] << 8);
+      r.pos += 4;
+      if (r.pos + length > size)
+        return false;
+      out.insert(out.end(), data + r.pos, data + r.pos + length);
+      r.pos += length;
+    }
+    else if (type == 1) {
+      unsigned char lengths[288];
+      for (int i = 0; i < 288; i++)
+        lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+      Huffman lit, dist;
+      lit.build(lengths, 288);
+      for (int i = 0; i < 30; i++)
+        lengths[i] = 5;
+      dist.build(lengths, 30);
+      if (!inflate_codes(r, lit, dist, out))
+        return false;
+    }
+    else if (type == 2) {
+      static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+      int nlen = r.bits(5) + 257, ndist = r.bits(5) + 1, ncode = r.bits(4) + 4;
+      unsigned char lengths[320];
+      memset(lengths, 0, sizeof(lengths));
+      for (int i = 0; i < ncode; i++)
+        lengths[order[i]] = r.bits(3);
+      Huffman code_lengths;
+      code_lengths.build(lengths, 19);
+      memset(lengths, 0, sizeof(lengths));
+      for (int i = 0; i < nlen + ndist; ) {
+        int symbol = code_lengths.decode(r);
+        if (r.error || symbol < 0)
+          return false;
+        if (symbol < 16)
+          lengths[i++] = symbol;
+        else {
+          int repeat, value = 0;
+          if (symbol == 16) {
+            if (i == 0)
+              return false;
+            value = lengths[i-1];
+            repeat = 3 + r.bits(2);
+          }
+          else if (symbol == 17)
+            repeat = 3 + r.bits(3);
+          else
+            repeat = 11 + r.bits(7);
+          if (i + repeat > nlen + ndist)
+            return false;
+          while (repeat--)
+            lengths[i++] = value;
+        }
+      }
+      Huffman lit, dist;
+      lit.build(lengths, nlen);
+      dist.build(lengths + nlen, ndist);
+      if (!inflate_codes(r, lit, dist, out))
+        return false;
+    }
+    else
+      return false;
+    if (r.error)
+      return false;
+  } while (!final);
+  return true;
+}
+
+/******
+ * PNG
+ ******/
+
+static void write_chunk (FILE* fp, const char* type, const std::vector<unsigned char>& data)
+{
+  std::vector<unsigned char> chunk;
+  put_be32(chunk, (unsigned int)data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  put_be32(chunk, crc32_update(0, &chunk[4], chunk.size() - 4));
+  fwrite(&chunk[0], 1, chunk.size(), fp);
+}
+
+bool write_png (const char* path, int width, int height, const unsigned char* pixels, int stride, bool bottom_up)
+{
+  FILE* fp = fopen(path, "wb");
+  if (!fp)
+    return false;
+
+  static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  fwrite(signature, 1, 8, fp);
+
+  std::vector<unsigned char> header;
+  put_be32(header, width);
+  put_be32(header, height);
+  header.push_back(8);  // bit depth
+  header.push_back(2);  // color type RGB, the shader never writes a meaningful alpha
+  header.push_back(0);
+  header.push_back(0);
+  header.push_back(0);
+  write_chunk(fp, "IHDR", header);
+
+  // Filter type 0 scanlines
+  size_t row_size = 1 + 3 * (size_t)width;
+  std::vector<unsigned char> raw(row_size * height);
+  for (int y = 0; y < height; y++) {
+    const unsigned char* src = pixels + 4 * (size_t)stride * (bottom_up ? height - 1 - y : y);
+    unsigned char* dst = &raw[row_size * y];
+    *dst++ = 0;
+    for (int x = 0; x < width; x++) {
+      *dst++ = src[4*x];
+      *dst++ = src[4*x + 1];
+      *dst++ = src[4*x + 2];
+    }
+  }
+
+  std::vector<unsigned char> idat;
+  idat.push_back(0x78);
+  idat.push_back(0x01);
+  deflate(raw, idat);
+  put_be32(idat, adler32(raw));
+  write_chunk(fp, "IDAT", idat);
+  write_chunk(fp, "IEND", std::vector<unsigned char>());
+
+  bool ok = !ferror(fp);
+  fclose(fp);
+  return ok;
+}
+
+static int paeth (int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = p > a ? p - a : a - p, pb = p > b ? p - b : b - p, pc = p > c ? p - c : c - p;
+  if (pa <= pb && pa <= pc)
+    return a;
+  return pb <= pc ? b : c;
+}
+
+bool read_png (const char* path, int* width, int* height, std::vector<unsigned char>& pixels)
+{
+  FILE* fp = fopen(path, "rb");
+  if (!fp)
+    return false;
+  std::vector<unsigned char> file;
+  unsigned char block[65536];
+  size_t got;
+  while ((got = fread(block, 1, sizeof(block), fp)) > 0)
+    file.insert(file.end(), block, block + got);
+  fclose(fp);
+
+  if (file.size() < 8 || memcmp(&file[0], "\x89PNG\r\n\x1a\n", 8))
+    return false;
+
+  int w = 0, h = 0, channels = 0;
+  std::vector<unsigned char> compressed;
+  for (size_t pos = 8; pos + 12 <= file.size(); ) {
+    unsigned int length = get_be32(&file[pos]);
+    if (pos + 12 + length > file.size())
+      return false;
+    const unsigned char* type = &file[pos + 4];
+    const unsigned char* data = &file[pos + 8];
+    if (!memcmp(type, "IHDR", 4)) {
+      w = get_be32(data);
+      h = get_be32(data + 4);
+      // 8 bit RGB or RGBA, no interlacing
+      if (data[8] != 8 || (data[9] != 2 && data[9] != 6) || data[12] != 0)
+        return false;
+      channels = data[9] == 2 ? 3 : 4;
+    }
+    else if (!memcmp(type, "IDAT", 4))
+      compressed.insert(compressed.end(), data, data + length);
+    else if (!memcmp(type, "IEND", 4))
+      break;
+    pos += 12 + length;
+  }
+  if (!channels || compressed.size() < 6)
+    return false;
+
+  std::vector<unsigned char> raw;
+  if (!inflate(&compressed[2], compressed.size() - 6, raw))
+    return false;
+  size_t row_size = (size_t)w * channels;
+  if (raw.size() < (row_size + 1) * h)
+    return false;
+
+  // Undo the scanline filters in place
+  for (int y = 0; y < h; y++) {
+    unsigned char* row = &raw[(row_size + 1) * y + 1];
+    unsigned char* prev = y ? row - row_size - 1 : NULL;
+    int filter = row[-1];
+    for (size_t x = 0; x < row_size; x++) {
+      int a = x >= (size_t)channels ? row[x - channels] : 0;
+      int b = prev ? prev[x] : 0;
+      int c = prev && x >= (size_t)channels ? prev[x - channels] : 0;
+      switch (filter) {
+        case 0: break;
+        case 1: row[x] += a; break;
+        case 2: row[x] += b; break;
+        case 3: row[x] += (a + b) / 2; break;
+        case 4: row[x] += paeth(a, b, c); break;
+        default: return false;
+      }
+    }
+  }
+
+  pixels.resize(4 * (size_t)w * h);
+  for (int y = 0; y < h; y++) {
+    const unsigned char* row = &raw[(row_size + 1) * y + 1];
+    for (int x = 0; x < w; x++) {
+      unsigned char* p = &pixels[4 * ((size_t)w * y + x)];
+      p[0] = row[channels*x];
+      p[1] = row[channels*x + 1];
+      p[2] = row[channels*x + 2];
+      p[3] = channels == 4 ? row[channels*x + 3] : 255;
+    }
+  }
+  *width = w;
+  *height = h;
+  return true;
+}
+
+bool write_raw_rgba (FILE* fp, int width, int height, const unsigned char* pixels, int stride, bool bottom_up)
+{
+  for (int y = 0; y < height; y++) {
+    const unsigned char* row = pixels + 4 * (size_t)stride * (bottom_up ? height - 1 - y : y);
+    if (fwrite(row, 4, width, fp) != (size_t)width)
+      return false;
+  }
+  return fflush(fp) == 0;
+}
@@ -0,0 +1,20 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <cstdio>
+#include <vector>
+
+/* Minimal PNG/raw image I/O for frame capture and the golden tests, no zlib needed.
+   pixels are RGBA8, stride is in pixels, bottom_up flips the rows
+   (glReadPixels returns the bottom row first). */
+
+/* 8 bit RGB PNG, compressed with a single fixed Huffman deflate block */
+bool write_png (const char* path, int width, int height, const unsigned char* pixels, int stride, bool bottom_up);
+
+/* Any non interlaced 8 bit RGB or RGBA PNG, returned as RGBA8 top row first */
+bool read_png (const char* path, int* width, int* height, std::vector<unsigned char>& pixels);
+
+/* Raw RGBA rows, top row first, appended to an open file or pipe */
+bool write_raw_rgba (FILE* fp, int width, int height, const unsigned char* pixels, int stride, bool bottom_up);
+
+#endif
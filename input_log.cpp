@@ -0,0 +1,121 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "input_log.h"
+
+#define INPUT_MAGIC "INPUTLG1"
+
+/* Events are a varint tick delta, a type byte and a varint key, most of
+   them take 3 bytes */
+static FILE* log_file = NULL;
+static unsigned long last_tick = 0;
+
+static void put_varint (FILE* fp, unsigned long value)
+{
+  while (value >= 0x80) {
+    fputc((int)(value & 0x7f) | 0x80, fp);
+    value >>= 7;
+  }
+  fputc((int)value, fp);
+}
+
+static bool get_varint (FILE* fp, unsigned long* value)
+{
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(fp);
+    if (c == EOF)
+      return false;
+    *value |= (unsigned long)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool input_record_start (const char* path, const InputStart& start)
+{
+  log_file = fopen(path, "wb");
+  if (!log_file) {
+    std::cerr << "input: could not write " << path << '\n';
+    return false;
+  }
+  last_tick = 0;
+  fwrite(INPUT_MAGIC, 1, 8, log_file);
+  fwrite(&start.step_rate, sizeof(start.step_rate), 1, log_file);
+  fwrite(&start.cannon_rotation, sizeof(start.cannon_rotation), 1, log_file);
+  fwrite(&start.speed, sizeof(start.speed), 1, log_file);
+  put_varint(log_file, start.spread);
+  put_varint(log_file, start.burst);
+  put_varint(log_file, start.level.size());
+  fwrite(start.level.data(), 1, start.level.size(), log_file);
+  fflush(log_file);
+  return true;
+}
+
+bool input_recording ()
+{
+  return log_file != NULL;
+}
+
+void input_record (unsigned long tick, InputEventType type, int key)
+{
+  if (!log_file)
+    return;
+  put_varint(log_file, tick - last_tick);
+  fputc(type, log_file);
+  put_varint(log_file, key);
+  fflush(log_file);
+  last_tick = tick;
+}
+
+void input_record_stop (unsigned long tick)
+{
+  if (!log_file)
+    return;
+  input_record(tick, INPUT_END, 0);
+  if (fclose(log_file) != 0)
+    std::cerr << "input: write failed\n";
+  log_file = NULL;
+}
+
+bool input_read (const char* path, InputStart& start, std::vector<InputEvent>& events)
+{
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    std::cerr << "input: could not open " << path << '\n';
+    return false;
+  }
+  char magic[8];
+  unsigned long spread, burst, length;
+  bool ok = fread(magic, 1, 8, fp) == 8 && !memcmp(magic, INPUT_MAGIC, 8) &&
+            fread(&start.step_rate, sizeof(start.step_rate), 1, fp) == 1 &&
+            fread(&start.cannon_rotation, sizeof(start.cannon_rotation), 1, fp) == 1 &&
+            fread(&start.speed, sizeof(start.speed), 1, fp) == 1 &&
+            get_varint(fp, &spread) && get_varint(fp, &burst) && get_varint(fp, &length) && length < 4096;
+  if (ok) {
+    start.spread = spread;
+    start.burst = burst;
+    start.level.resize(length);
+    ok = fread(&start.level[0], 1, length, fp) == length;
+  }
+  if (!ok) {
+    std::cerr << "input: " << path << " is not an input log\n";
+    fclose(fp);
+    return false;
+  }
+
+  events.clear();
+  unsigned long tick = 0, delta, key;
+  int type;
+  while (get_varint(fp, &delta) && (type = fgetc(fp)) != EOF && get_varint(fp, &key)) {
+    tick += delta;
+    InputEvent e = { tick, (InputEventType) type, (int) key };
+    events.push_back(e);
+    if (type == INPUT_END)
+      break;
+  }
+  fclose(fp);
+  return true;
+}
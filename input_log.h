@@ -0,0 +1,43 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <string>
+#include <vector>
+
+/* Recording of the player's input, stamped with the simulation tick it
+   took effect on, so a replay that applies every event right before its
+   tick steps through exactly the same states. The log starts with the
+   settings the run began with and is flushed on every event, a crash
+   keeps everything up to it. */
+
+enum InputEventType {
+  INPUT_END,       // the run stopped at this tick
+  INPUT_PRESS,
+  INPUT_RELEASE
+};
+
+struct InputEvent {
+  unsigned long tick;
+  InputEventType type;
+  int key;          // GLFW key code
+};
+
+/* State of the game at tick 0 */
+struct InputStart {
+  double step_rate;
+  float cannon_rotation;
+  float speed;
+  int spread, burst;
+  std::string level;
+};
+
+bool input_record_start (const char* path, const InputStart& start);
+bool input_recording ();
+void input_record (unsigned long tick, InputEventType type, int key);
+/* Writes the INPUT_END event and closes the log */
+void input_record_stop (unsigned long tick);
+
+/* The whole log; a log cut short by a crash ends at its last event */
+bool input_read (const char* path, InputStart& start, std::vector<InputEvent>& events);
+
+#endif
@@ -0,0 +1,306 @@
+#include <cstring>
+#include <cstdint>
+
+#include "integrate.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Reference kernel, also finishes the last few balls of the SIMD ones.
+   The SIMD kernels do the same operations in the same order. The build
+   has -ffp-contract=off so the compiler does not fuse a multiply and an
+   add in one kernel and not in another, bench checks that they agree. */
+static void integrateScalar (Projectiles& p, const IntegrateParams& k, int begin, int end)
+{
+  float* __restrict x = &p.x[0];
+  float* __restrict y = &p.y[0];
+  float* __restrict vx = &p.vx[0];
+  float* __restrict vy = &p.vy[0];
+  float* __restrict px = &p.px[0];
+  float* __restrict py = &p.py[0];
+  float* __restrict life = &p.life[0];
+  unsigned char* __restrict alive = &p.alive[0];
+  unsigned char* __restrict bounced = &p.bounced[0];
+
+  for (int i = begin; i < end; i++) {
+    px[i] = x[i];
+    py[i] = y[i];
+    float nx = x[i] + vx[i] * k.dt;
+    float ny = (y[i] + vy[i] * k.dt) + k.drop;
+    float nvy = vy[i] + k.dv;
+    // Rebound only when moving outwards so a ball cannot stick in a wall
+    int out_x = ((nx < k.left) & (vx[i] < 0)) | ((nx > k.right) & (vx[i] > 0));
+    int out_y = ((ny < k.bottom) & (nvy < 0)) | ((ny > k.top) & (nvy > 0));
+    // Swept: the part of the step past the wall is mirrored back and damped
+    // like the speed, then clamped in case it reaches the other wall too
+    float wx = nx < k.left ? k.left : k.right;
+    float wy = ny < k.bottom ? k.bottom : k.top;
+    float rx = wx + (nx - wx) * k.bounce;
+    float ry = wy + (ny - wy) * k.bounce;
+    rx = rx > k.left ? rx : k.left;
+    rx = rx < k.right ? rx : k.right;
+    ry = ry > k.bottom ? ry : k.bottom;
+    ry = ry < k.top ? ry : k.top;
+    vx[i] = out_x ? vx[i] * k.bounce : vx[i];
+    vy[i] = out_y ? nvy * k.bounce : nvy;
+    x[i] = out_x ? rx : nx;
+    y[i] = out_y ? ry : ny;
+    bounced[i] = out_x | (out_y << 1);
+    life[i] -= k.dt;
+    alive[i] = life[i] > 0;
+  }
+}
+
+#ifdef HAVE_X86
+
+/* movemask of 8 lanes -> 8 bytes of 0/1, for the alive flags */
+static uint64_t mask_bytes[256];
+
+static struct MaskBytesInit {
+  MaskBytesInit () {
+    for (int m = 0; m < 256; m++) {
+      uint64_t bytes = 0;
+      for (int b = 0; b < 8; b++)
+        if (m & (1 << b))
+          bytes |= (uint64_t)1 << (8 * b);
+      mask_bytes[m] = bytes;
+    }
+  }
+} mask_bytes_init;
+
+// m ? a : b per lane, without SSE4.1 blends
+#define SELECT(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+
+static void integrateSSE2 (Projectiles& p, const IntegrateParams& k, int begin, int end)
+{
+  float* x = &p.x[0];
+  float* y = &p.y[0];
+  float* vx = &p.vx[0];
+  float* vy = &p.vy[0];
+  float* px = &p.px[0];
+  float* py = &p.py[0];
+  float* life = &p.life[0];
+  unsigned char* alive = &p.alive[0];
+  unsigned char* bounced = &p.bounced[0];
+
+  const __m128 dt = _mm_set1_ps(k.dt), drop = _mm_set1_ps(k.drop), dv = _mm_set1_ps(k.dv);
+  const __m128 bounce = _mm_set1_ps(k.bounce), zero = _mm_setzero_ps();
+  const __m128 left = _mm_set1_ps(k.left), right = _mm_set1_ps(k.right);
+  const __m128 bottom = _mm_set1_ps(k.bottom), top = _mm_set1_ps(k.top);
+
+  int i = begin;
+  for (; i + 4 <= end; i += 4) {
+    __m128 x0 = _mm_loadu_ps(x + i), y0 = _mm_loadu_ps(y + i);
+    __m128 vx0 = _mm_loadu_ps(vx + i), vy0 = _mm_loadu_ps(vy + i);
+    _mm_storeu_ps(px + i, x0);
+    _mm_storeu_ps(py + i, y0);
+    __m128 nx = _mm_add_ps(x0, _mm_mul_ps(vx0, dt));
+    __m128 ny = _mm_add_ps(_mm_add_ps(y0, _mm_mul_ps(vy0, dt)), drop);
+    __m128 nvy = _mm_add_ps(vy0, dv);
+    __m128 out_x = _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(nx, left), _mm_cmplt_ps(vx0, zero)),
+                             _mm_and_ps(_mm_cmpgt_ps(nx, right), _mm_cmpgt_ps(vx0, zero)));
+    __m128 out_y = _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(ny, bottom), _mm_cmplt_ps(nvy, zero)),
+                             _mm_and_ps(_mm_cmpgt_ps(ny, top), _mm_cmpgt_ps(nvy, zero)));
+    __m128 wx = SELECT(_mm_cmplt_ps(nx, left), left, right);
+    __m128 wy = SELECT(_mm_cmplt_ps(ny, bottom), bottom, top);
+    __m128 rx = _mm_add_ps(wx, _mm_mul_ps(_mm_sub_ps(nx, wx), bounce));
+    __m128 ry = _mm_add_ps(wy, _mm_mul_ps(_mm_sub_ps(ny, wy), bounce));
+    rx = _mm_min_ps(_mm_max_ps(rx, left), right);
+    ry = _mm_min_ps(_mm_max_ps(ry, bottom), top);
+    _mm_storeu_ps(vx + i, SELECT(out_x, _mm_mul_ps(vx0, bounce), vx0));
+    _mm_storeu_ps(vy + i, SELECT(out_y, _mm_mul_ps(nvy, bounce), nvy));
+    _mm_storeu_ps(x + i, SELECT(out_x, rx, nx));
+    _mm_storeu_ps(y + i, SELECT(out_y, ry, ny));
+    __m128 l = _mm_sub_ps(_mm_loadu_ps(life + i), dt);
+    _mm_storeu_ps(life + i, l);
+    uint32_t flags = (uint32_t)mask_bytes[_mm_movemask_ps(_mm_cmpgt_ps(l, zero))];
+    memcpy(alive + i, &flags, 4);
+    flags = (uint32_t)(mask_bytes[_mm_movemask_ps(out_x)] | mask_bytes[_mm_movemask_ps(out_y)] << 1);
+    memcpy(bounced + i, &flags, 4);
+  }
+  integrateScalar(p, k, i, end);
+}
+
+__attribute__((target("avx2")))
+static void integrateAVX2 (Projectiles& p, const IntegrateParams& k, int begin, int end)
+{
+  float* x = &p.x[0];
+  float* y = &p.y[0];
+  float* vx = &p.vx[0];
+  float* vy = &p.vy[0];
+  float* px = &p.px[0];
+  float* py = &p.py[0];
+  float* life = &p.life[0];
+  unsigned char* alive = &p.alive[0];
+  unsigned char* bounced = &p.bounced[0];
+
+  const __m256 dt = _mm256_set1_ps(k.dt), drop = _mm256_set1_ps(k.drop), dv = _mm256_set1_ps(k.dv);
+  const __m256 bounce = _mm256_set1_ps(k.bounce), zero = _mm256_setzero_ps();
+  const __m256 left = _mm256_set1_ps(k.left), right = _mm256_set1_ps(k.right);
+  const __m256 bottom = _mm256_set1_ps(k.bottom), top = _mm256_set1_ps(k.top);
+
+  int i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 x0 = _mm256_loadu_ps(x + i), y0 = _mm256_loadu_ps(y + i);
+    __m256 vx0 = _mm256_loadu_ps(vx + i), vy0 = _mm256_loadu_ps(vy + i);
+    _mm256_storeu_ps(px + i, x0);
+    _mm256_storeu_ps(py + i, y0);
+    // mul then add, never fused, to match the scalar kernel
+    __m256 nx = _mm256_add_ps(x0, _mm256_mul_ps(vx0, dt));
+    __m256 ny = _mm256_add_ps(_mm256_add_ps(y0, _mm256_mul_ps(vy0, dt)), drop);
+    __m256 nvy = _mm256_add_ps(vy0, dv);
+    __m256 out_x = _mm256_or_ps(_mm256_and_ps(_mm256_cmp_ps(nx, left, _CMP_LT_OQ), _mm256_cmp_ps(vx0, zero, _CMP_LT_OQ)),
+                                _mm256_and_ps(_mm256_cmp_ps(nx, right, _CMP_GT_OQ), _mm256_cmp_ps(vx0, zero, _CMP_GT_OQ)));
+    __m256 out_y = _mm256_or_ps(_mm256_and_ps(_mm256_cmp_ps(ny, bottom, _CMP_LT_OQ), _mm256_cmp_ps(nvy, zero, _CMP_LT_OQ)),
+                                _mm256_and_ps(_mm256_cmp_ps(ny, top, _CMP_GT_OQ), _mm256_cmp_ps(nvy, zero, _CMP_GT_OQ)));
+    __m256 wx = _mm256_blendv_ps(right, left, _mm256_cmp_ps(nx, left, _CMP_LT_OQ));
+    __m256 wy = _mm256_blendv_ps(top, bottom, _mm256_cmp_ps(ny, bottom, _CMP_LT_OQ));
+    __m256 rx = _mm256_add_ps(wx, _mm256_mul_ps(_mm256_sub_ps(nx, wx), bounce));
+    __m256 ry = _mm256_add_ps(wy, _mm256_mul_ps(_mm256_sub_ps(ny, wy), bounce));
+    rx = _mm256_min_ps(_mm256_max_ps(rx, left), right);
+    ry = _mm256_min_ps(_mm256_max_ps(ry, bottom), top);
+    _mm256_storeu_ps(vx + i, _mm256_blendv_ps(vx0, _mm256_mul_ps(vx0, bounce), out_x));
+    _mm256_storeu_ps(vy + i, _mm256_blendv_ps(nvy, _mm256_mul_ps(nvy, bounce), out_y));
+    _mm256_storeu_ps(x + i, _mm256_blendv_ps(nx, rx, out_x));
+    _mm256_storeu_ps(y + i, _mm256_blendv_ps(ny, ry, out_y));
+    __m256 l = _mm256_sub_ps(_mm256_loadu_ps(life + i), dt);
+    _mm256_storeu_ps(life + i, l);
+    uint64_t flags = mask_bytes[_mm256_movemask_ps(_mm256_cmp_ps(l, zero, _CMP_GT_OQ))];
+    memcpy(alive + i, &flags, 8);
+    flags = mask_bytes[_mm256_movemask_ps(out_x)] | mask_bytes[_mm256_movemask_ps(out_y)] << 1;
+    memcpy(bounced + i, &flags, 8);
+  }
+  integrateScalar(p, k, i, end);
+}
+
+#endif
+
+#ifdef HAVE_NEON
+
+static void integrateNEON (Projectiles& p, const IntegrateParams& k, int begin, int end)
+{
+  float* x = &p.x[0];
+  float* y = &p.y[0];
+  float* vx = &p.vx[0];
+  float* vy = &p.vy[0];
+  float* px = &p.px[0];
+  float* py = &p.py[0];
+  float* life = &p.life[0];
+  unsigned char* alive = &p.alive[0];
+  unsigned char* bounced = &p.bounced[0];
+
+  const float32x4_t dt = vdupq_n_f32(k.dt), drop = vdupq_n_f32(k.drop), dv = vdupq_n_f32(k.dv);
+  const float32x4_t bounce = vdupq_n_f32(k.bounce), zero = vdupq_n_f32(0);
+  const float32x4_t left = vdupq_n_f32(k.left), right = vdupq_n_f32(k.right);
+  const float32x4_t bottom = vdupq_n_f32(k.bottom), top = vdupq_n_f32(k.top);
+  const uint32x4_t one = vdupq_n_u32(1);
+
+  int i = begin;
+  for (; i + 4 <= end; i += 4) {
+    float32x4_t x0 = vld1q_f32(x + i), y0 = vld1q_f32(y + i);
+    float32x4_t vx0 = vld1q_f32(vx + i), vy0 = vld1q_f32(vy + i);
+    vst1q_f32(px + i, x0);
+    vst1q_f32(py + i, y0);
+    // vmulq + vaddq rather than vmlaq, which may be fused
+    float32x4_t nx = vaddq_f32(x0, vmulq_f32(vx0, dt));
+    float32x4_t ny = vaddq_f32(vaddq_f32(y0, vmulq_f32(vy0, dt)), drop);
+    float32x4_t nvy = vaddq_f32(vy0, dv);
+    uint32x4_t out_x = vorrq_u32(vandq_u32(vcltq_f32(nx, left), vcltq_f32(vx0, zero)),
+                                 vandq_u32(vcgtq_f32(nx, right), vcgtq_f32(vx0, zero)));
+    uint32x4_t out_y = vorrq_u32(vandq_u32(vcltq_f32(ny, bottom), vcltq_f32(nvy, zero)),
+                                 vandq_u32(vcgtq_f32(ny, top), vcgtq_f32(nvy, zero)));
+    float32x4_t wx = vbslq_f32(vcltq_f32(nx, left), left, right);
+    float32x4_t wy = vbslq_f32(vcltq_f32(ny, bottom), bottom, top);
+    float32x4_t rx = vaddq_f32(wx, vmulq_f32(vsubq_f32(nx, wx), bounce));
+    float32x4_t ry = vaddq_f32(wy, vmulq_f32(vsubq_f32(ny, wy), bounce));
+    rx = vminq_f32(vmaxq_f32(rx, left), right);
+    ry = vminq_f32(vmaxq_f32(ry, bottom), top);
+    vst1q_f32(vx + i, vbslq_f32(out_x, vmulq_f32(vx0, bounce), vx0));
+    vst1q_f32(vy + i, vbslq_f32(out_y, vmulq_f32(nvy, bounce), nvy));
+    vst1q_f32(x + i, vbslq_f32(out_x, rx, nx));
+    vst1q_f32(y + i, vbslq_f32(out_y, ry, ny));
+    float32x4_t l = vsubq_f32(vld1q_f32(life + i), dt);
+    vst1q_f32(life + i, l);
+    uint16x4_t narrow = vmovn_u32(vandq_u32(vcgtq_f32(l, zero), one));
+    uint8x8_t bytes = vmovn_u16(vcombine_u16(narrow, narrow));
+    uint32_t flags = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+    memcpy(alive + i, &flags, 4);
+    uint32x4_t walls = vorrq_u32(vandq_u32(out_x, one), vandq_u32(out_y, vdupq_n_u32(2)));
+    narrow = vmovn_u32(walls);
+    bytes = vmovn_u16(vcombine_u16(narrow, narrow));
+    flags = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+    memcpy(bounced + i, &flags, 4);
+  }
+  integrateScalar(p, k, i, end);
+}
+
+#endif
+
+struct KernelEntry {
+  const char* name;
+  IntegrateKernel kernel;
+};
+
+static const KernelEntry kernels[] = {
+  { "scalar", integrateScalar },
+#ifdef HAVE_X86
+  { "sse2", integrateSSE2 },
+  { "avx2", integrateAVX2 },
+#endif
+#ifdef HAVE_NEON
+  { "neon", integrateNEON },
+#endif
+};
+static const int num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+
+static const KernelEntry* current = NULL;
+
+static bool supported (const char* name)
+{
+#ifdef HAVE_X86
+  if (!strcmp(name, "sse2"))
+    return __builtin_cpu_supports("sse2");
+  if (!strcmp(name, "avx2"))
+    return __builtin_cpu_supports("avx2");
+#endif
+  return true;
+}
+
+bool integrate_select (const char* name)
+{
+  if (!strcmp(name, "auto")) {
+    // Best supported kernel, they are listed slowest first
+    for (int i = 0; i < num_kernels; i++)
+      if (supported(kernels[i].name))
+        current = &kernels[i];
+    return true;
+  }
+  for (int i = 0; i < num_kernels; i++) {
+    if (!strcmp(name, kernels[i].name) && supported(name)) {
+      current = &kernels[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* integrate_kernel_name ()
+{
+  if (!current)
+    integrate_select("auto");
+  return current->name;
+}
+
+void integrate (Projectiles& p, const IntegrateParams& k, int begin, int end)
+{
+  if (!current)
+    integrate_select("auto");
+  if (begin < end)
+    current->kernel(p, k, begin, end);
+}
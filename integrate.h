@@ -0,0 +1,28 @@
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+#include "projectiles.h"
+
+/* Ball integration kernels: one step of gravity plus wall rebounds for a
+   range of the projectile pool. Every kernel gives bit for bit the same
+   result as the scalar one, the fastest the CPU supports is picked at
+   startup. */
+
+struct IntegrateParams {
+  float dt;
+  float drop;          // 0.5 * gravity * dt^2
+  float dv;            // gravity * dt
+  float bounce;        // velocity factor on a rebound, -(1 - damping)
+  float left, right, bottom, top;
+};
+
+typedef void (*IntegrateKernel) (Projectiles& p, const IntegrateParams& k, int begin, int end);
+
+/* Current kernel, selected on first use */
+void integrate (Projectiles& p, const IntegrateParams& k, int begin, int end);
+
+/* "scalar", "sse2", "avx2", "neon" or "auto". False if the CPU or the build lacks it. */
+bool integrate_select (const char* name);
+const char* integrate_kernel_name ();
+
+#endif
@@ -0,0 +1,170 @@
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "jobs.h"
+#include "trace.h"
+
+struct Job {
+  JobFunc fn;
+  void* data;
+  int begin, end;
+  JobCounter* counter;
+};
+
+struct JobQueue {
+  std::mutex lock;
+  std::deque<Job> jobs;
+};
+
+// Queue 0 is shared by the threads that are not workers
+static std::vector<JobQueue*> queues;
+static std::vector<std::thread> workers;
+static thread_local int queue_index = 0;
+
+static std::mutex sleep_mutex;
+static std::condition_variable wake;
+static std::atomic<int> queued(0);
+static bool exiting = false;
+static bool started = false;
+
+static void push_job (const Job& job)
+{
+  job.counter->pending.fetch_add(1, std::memory_order_relaxed);
+  JobQueue* q = queues[queue_index];
+  std::lock_guard<std::mutex> lock(q->lock);
+  q->jobs.push_back(job);
+  queued.fetch_add(1);
+}
+
+static void wake_workers (int count)
+{
+  // Taking the lock orders this after a sleeper's check of 'queued'
+  { std::lock_guard<std::mutex> lock(sleep_mutex); }
+  if (count > 1)
+    wake.notify_all();
+  else
+    wake.notify_one();
+}
+
+/* Newest job of our own queue, else the oldest one of another */
+static bool pop_job (Job& job)
+{
+  int n = queues.size();
+  for (int k = 0; k < n; k++) {
+    int i = (queue_index + k) % n;
+    JobQueue* q = queues[i];
+    std::lock_guard<std::mutex> lock(q->lock);
+    if (q->jobs.empty())
+      continue;
+    if (k == 0) {
+      job = q->jobs.back();
+      q->jobs.pop_back();
+    }
+    else {
+      job = q->jobs.front();
+      q->jobs.pop_front();
+    }
+    queued.fetch_sub(1);
+    return true;
+  }
+  return false;
+}
+
+static void run_job (const Job& job)
+{
+  TraceScope trace("job");
+  job.fn(job.data, job.begin, job.end);
+  job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+static void worker_main (int index)
+{
+  trace_thread_name("job worker");
+  queue_index = index;
+  Job job;
+  for (;;) {
+    if (pop_job(job)) {
+      run_job(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake.wait(lock, [] { return queued.load() > 0 || exiting; });
+    if (exiting && queued.load() == 0)
+      return;
+  }
+}
+
+void jobs_init (int threads)
+{
+  if (started)
+    return;
+  if (threads <= 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  started = true;
+  exiting = false;
+  for (int i = 0; i < threads; i++)
+    queues.push_back(new JobQueue);
+  // The calling thread works while it waits
+  for (int i = 1; i < threads; i++)
+    workers.push_back(std::thread(worker_main, i));
+}
+
+void jobs_shutdown ()
+{
+  if (!started)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    exiting = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+  workers.clear();
+  for (size_t i = 0; i < queues.size(); i++)
+    delete queues[i];
+  queues.clear();
+  started = false;
+}
+
+int jobs_threads ()
+{
+  return queues.size();
+}
+
+void jobs_run (JobFunc fn, void* data, JobCounter* counter, int begin, int end)
+{
+  jobs_init();
+  Job job = { fn, data, begin, end, counter };
+  push_job(job);
+  wake_workers(1);
+}
+
+void jobs_parallel_for (JobFunc fn, void* data, int count, int chunk, JobCounter* counter)
+{
+  jobs_init();
+  if (chunk < 1)
+    chunk = 1;
+  int jobs = 0;
+  for (int begin = 0; begin < count; begin += chunk, jobs++) {
+    Job job = { fn, data, begin, std::min(begin + chunk, count), counter };
+    push_job(job);
+  }
+  if (jobs)
+    wake_workers(jobs);
+}
+
+void jobs_wait (JobCounter* counter)
+{
+  Job job;
+  while (counter->pending.load(std::memory_order_acquire) > 0) {
+    if (pop_job(job))
+      run_job(job);
+    else
+      std::this_thread::yield();
+  }
+}
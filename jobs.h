@@ -0,0 +1,30 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+
+/* Work-stealing job system. One worker per core (the calling thread counts
+   as one): each keeps its own deque, takes its newest job first and steals
+   the oldest of another when it runs out. Waiting on a counter runs jobs
+   instead of blocking, so jobs may start and wait on more jobs. */
+
+typedef void (*JobFunc) (void* data, int begin, int end);
+
+/* Counts the unfinished jobs of a batch */
+struct JobCounter {
+  std::atomic<int> pending;
+  JobCounter () : pending(0) {}
+};
+
+/* threads <= 0: one per core. 1 runs every job on the waiting thread. */
+void jobs_init (int threads=0);
+void jobs_shutdown ();
+int jobs_threads ();
+
+/* fn(data, begin, end) as one job */
+void jobs_run (JobFunc fn, void* data, JobCounter* counter, int begin=0, int end=0);
+/* fn(data, begin, end) over [0, count) in chunks of at most 'chunk' */
+void jobs_parallel_for (JobFunc fn, void* data, int count, int chunk, JobCounter* counter);
+void jobs_wait (JobCounter* counter);
+
+#endif
@@ -0,0 +1,192 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "level.h"
+
+// Every array starts on this boundary, so it can be read in place
+#define LEVEL_ALIGN 16
+
+static bool section_ok (const LevelHeader& h, uint32_t offset, uint32_t count, size_t element)
+{
+  return offset % LEVEL_ALIGN == 0 && offset >= sizeof(LevelHeader) &&
+         offset <= h.size && (h.size - offset) / element >= count;
+}
+
+/* The physics trusts these: finite coordinates, positive radii and
+   polygons of 3 to MAX_POLYGON_VERTICES corners */
+static const char* contents_problem (const Level& level)
+{
+  const LevelHeader& h = *level.header;
+  for (uint32_t i = 0; i < h.target_count; i++) {
+    const Target& t = level.targets[i];
+    if (!std::isfinite(t.x) || !std::isfinite(t.y) || !(t.radius > 0) || !std::isfinite(t.radius))
+      return "a target has no finite position and positive radius";
+  }
+  for (uint32_t i = 0; i < h.obstacle_count; i++) {
+    const Polygon& p = level.obstacles[i];
+    if (p.count < 3 || p.count > MAX_POLYGON_VERTICES)
+      return "an obstacle has too few or too many corners";
+    for (int k = 0; k < p.count; k++)
+      if (!std::isfinite(p.x[k]) || !std::isfinite(p.y[k]) || !std::isfinite(p.nx[k]) || !std::isfinite(p.ny[k]))
+        return "an obstacle has a corner or normal that is not finite";
+    const Box& b = p.box;
+    if (!std::isfinite(b.min_x) || !std::isfinite(b.min_y) || !std::isfinite(b.max_x) || !std::isfinite(b.max_y) ||
+        b.min_x > b.max_x || b.min_y > b.max_y)
+      return "an obstacle has a bad bounding box";
+  }
+  return NULL;
+}
+
+/* Sets the pointers of a level to the arrays of its data */
+static void point (Level& level, void* data, size_t size)
+{
+  const LevelHeader& h = *(const LevelHeader*) data;
+  const char* base = (const char*) data;
+  level.data = data;
+  level.size = size;
+  level.header = &h;
+  level.targets = (const Target*) (base + h.targets);
+  level.target_colors = (const float*) (base + h.target_colors);
+  level.obstacles = (const Polygon*) (base + h.obstacles);
+  level.vertices = (const float*) (base + h.vertices);
+  level.colors = (const float*) (base + h.colors);
+}
+
+bool level_load (Level& level, const char* path)
+{
+  memset(&level, 0, sizeof(level));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "level: could not open " << path << '\n';
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LevelHeader)) {
+    std::cerr << "level: " << path << " is too short\n";
+    close(fd);
+    return false;
+  }
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    std::cerr << "level: could not map " << path << '\n';
+    return false;
+  }
+
+  const LevelHeader& h = *(const LevelHeader*) data;
+  const char* problem = NULL;
+  if (h.magic != LEVEL_MAGIC)
+    problem = "not a compiled level";
+  else if (h.version != LEVEL_VERSION)
+    problem = "compiled for another version, run levelc again";
+  else if (h.size != (uint64_t)st.st_size)
+    problem = "truncated";
+  else if (!section_ok(h, h.targets, h.target_count, sizeof(Target)) ||
+           !section_ok(h, h.target_colors, h.target_count, 3 * sizeof(float)) ||
+           !section_ok(h, h.obstacles, h.obstacle_count, sizeof(Polygon)) ||
+           !section_ok(h, h.vertices, h.vertex_count, 3 * sizeof(float)) ||
+           !section_ok(h, h.colors, h.vertex_count, 3 * sizeof(float)))
+    problem = "an array lies outside the file";
+  else {
+    point(level, data, st.st_size);
+    problem = contents_problem(level);
+  }
+  if (problem) {
+    std::cerr << "level: " << path << ": " << problem << '\n';
+    munmap(data, st.st_size);
+    memset(&level, 0, sizeof(level));
+    return false;
+  }
+  return true;
+}
+
+void level_unload (Level& level)
+{
+  if (level.data)
+    munmap(level.data, level.size);
+  memset(&level, 0, sizeof(level));
+}
+
+/* Appends an array on the next aligned offset and returns that offset */
+static uint32_t append (std::vector<char>& out, const void* data, size_t bytes)
+{
+  out.resize((out.size() + LEVEL_ALIGN - 1) / LEVEL_ALIGN * LEVEL_ALIGN, 0);
+  uint32_t offset = out.size();
+  out.insert(out.end(), (const char*) data, (const char*) data + bytes);
+  return offset;
+}
+
+/* The layout of a compiled level in memory, false if it would not fit the
+   32 bit offsets */
+static bool pack (std::vector<char>& out, const std::vector<Target>& targets, const std::vector<float>& target_colors,
+                  const std::vector<Polygon>& obstacles, const std::vector<float>& vertices, const std::vector<float>& colors)
+{
+  size_t bytes = sizeof(LevelHeader) + targets.size() * sizeof(Target) + (target_colors.size() + vertices.size() + colors.size()) * sizeof(float) +
+                 obstacles.size() * sizeof(Polygon) + 6 * LEVEL_ALIGN;
+  if (bytes > UINT32_MAX) {
+    std::cerr << "level: " << bytes << " bytes do not fit a level\n";
+    return false;
+  }
+  out.assign(sizeof(LevelHeader), 0);
+  out.reserve(bytes);
+  LevelHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = LEVEL_MAGIC;
+  h.version = LEVEL_VERSION;
+  h.target_count = targets.size();
+  h.targets = append(out, targets.data(), targets.size() * sizeof(Target));
+  h.target_colors = append(out, target_colors.data(), target_colors.size() * sizeof(float));
+  h.obstacle_count = obstacles.size();
+  h.obstacles = append(out, obstacles.data(), obstacles.size() * sizeof(Polygon));
+  h.vertex_count = vertices.size() / 3;
+  h.vertices = append(out, vertices.data(), vertices.size() * sizeof(float));
+  h.colors = append(out, colors.data(), colors.size() * sizeof(float));
+  out.resize((out.size() + LEVEL_ALIGN - 1) / LEVEL_ALIGN * LEVEL_ALIGN, 0);
+  h.size = out.size();
+  memcpy(&out[0], &h, sizeof(h));
+  return true;
+}
+
+bool level_write (const char* path, const std::vector<Target>& targets, const std::vector<float>& target_colors,
+                  const std::vector<Polygon>& obstacles, const std::vector<float>& vertices, const std::vector<float>& colors)
+{
+  std::vector<char> out;
+  if (!pack(out, targets, target_colors, obstacles, vertices, colors))
+    return false;
+
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    std::cerr << "level: could not write " << path << '\n';
+    return false;
+  }
+  bool ok = fwrite(&out[0], 1, out.size(), fp) == out.size();
+  ok = fclose(fp) == 0 && ok;
+  if (!ok)
+    std::cerr << "level: write failed on " << path << '\n';
+  return ok;
+}
+
+bool level_build (Level& level, const std::vector<Target>& targets, const std::vector<float>& target_colors,
+                  const std::vector<Polygon>& obstacles, const std::vector<float>& vertices, const std::vector<float>& colors)
+{
+  memset(&level, 0, sizeof(level));
+  std::vector<char> out;
+  if (!pack(out, targets, target_colors, obstacles, vertices, colors))
+    return false;
+  // Anonymous memory, so level_unload frees it like a mapped file
+  void* data = mmap(NULL, out.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    std::cerr << "level: could not allocate " << out.size() << " bytes\n";
+    return false;
+  }
+  memcpy(data, &out[0], out.size());
+  point(level, data, out.size());
+  return true;
+}
@@ -0,0 +1,63 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include "colliders.h"
+
+/* Levels are written as JSON in levels/ and compiled by levelc into a
+   binary that is mapped into memory as it is: a fixed header followed by
+   packed arrays the game hands straight to the simulation and the
+   renderer, nothing is parsed at load time. The binary is native endian
+   and tied to the layout of Target and Polygon, LEVEL_VERSION changes
+   with them. */
+
+#define LEVEL_MAGIC 0x314c564cu   // "LVL1" in a little endian file
+#define LEVEL_VERSION 1
+
+// Bump LEVEL_VERSION when these fail
+static_assert(sizeof(Target) == 12, "Target layout of the level files changed");
+static_assert(sizeof(Polygon) == 4 + 4 * 4 * MAX_POLYGON_VERTICES + sizeof(Box), "Polygon layout of the level files changed");
+
+struct LevelHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;             // bytes in the whole file
+  uint32_t target_count;
+  uint32_t targets;          // offset of Target[target_count]
+  uint32_t target_colors;    // offset of float[3 * target_count], RGB
+  uint32_t obstacle_count;
+  uint32_t obstacles;        // offset of Polygon[obstacle_count], the colliders
+  uint32_t vertex_count;
+  uint32_t vertices;         // offset of float[3 * vertex_count], xyz of the obstacle triangles
+  uint32_t colors;           // offset of float[3 * vertex_count], RGB
+};
+
+/* A mapped level, every pointer points into the mapping */
+struct Level {
+  void* data;
+  size_t size;
+  const LevelHeader* header;
+  const Target* targets;
+  const float* target_colors;
+  const Polygon* obstacles;
+  const float* vertices;
+  const float* colors;
+};
+
+/* Maps a compiled level and checks that its arrays lie inside the file
+   and hold what the physics can use */
+bool level_load (Level& level, const char* path);
+void level_unload (Level& level);
+
+/* The compiler's side: packs the arrays behind a header */
+bool level_write (const char* path, const std::vector<Target>& targets, const std::vector<float>& target_colors,
+                  const std::vector<Polygon>& obstacles, const std::vector<float>& vertices, const std::vector<float>& colors);
+/* The same layout in memory instead of a file, for levels made at run
+   time. level_unload frees it. */
+bool level_build (Level& level, const std::vector<Target>& targets, const std::vector<float>& target_colors,
+                  const std::vector<Polygon>& obstacles, const std::vector<float>& vertices, const std::vector<float>& colors);
+
+#endif
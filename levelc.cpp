@@ -0,0 +1,288 @@
+/* Compiles a JSON level into the binary the game maps, see level.h
+   levelc levels/default.json levels/default.lvl
+
+   {
+     "targets": [ { "x": 4.3, "y": 3, "radius": 0.5, "color": [0.6, 0.56, 0.21] } ],
+     "obstacles": [
+       { "outline": [[2, 0], [2.5, 0], [2.5, 3], [2, 3]], "color": [0.2, 0.2, 0.2] },
+       { "triangles": [[7, 0], [7.6, 0], [7.3, 1]], "colors": [[0.5, 0.5, 0.5], ...] }
+     ]
+   }
+
+   An outline is a convex polygon in either winding, drawn as a fan in one
+   color. Triangles are drawn as they are, with a color per corner. Either
+   way the collider is the convex hull of the corners. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "level.h"
+
+/* Just enough JSON for level files: no escapes beyond \" and \\ */
+struct Json {
+  enum { NUMBER, STRING, ARRAY, OBJECT, LITERAL } type;
+  double number;
+  std::string text;
+  std::vector<Json> items;
+  std::map<std::string, Json> members;
+};
+
+struct Parser {
+  const char* p;
+  const char* start;
+  const char* error;
+};
+
+static void skipSpace (Parser& ps)
+{
+  while (*ps.p == ' ' || *ps.p == '\t' || *ps.p == '\n' || *ps.p == '\r')
+    ps.p++;
+}
+
+static bool fail (Parser& ps, const char* message)
+{
+  if (!ps.error)
+    ps.error = message;
+  return false;
+}
+
+static bool parseString (Parser& ps, std::string& out)
+{
+  ps.p++;
+  while (*ps.p != '"') {
+    if (!*ps.p)
+      return fail(ps, "unterminated string");
+    if (*ps.p == '\\' && ps.p[1])
+      ps.p++;
+    out += *ps.p++;
+  }
+  ps.p++;
+  return true;
+}
+
+static bool parseValue (Parser& ps, Json& v)
+{
+  skipSpace(ps);
+  if (*ps.p == '{') {
+    v.type = Json::OBJECT;
+    ps.p++;
+    skipSpace(ps);
+    if (*ps.p == '}') {
+      ps.p++;
+      return true;
+    }
+    for (;;) {
+      skipSpace(ps);
+      std::string key;
+      if (*ps.p != '"' || !parseString(ps, key))
+        return fail(ps, "expected a key");
+      skipSpace(ps);
+      if (*ps.p++ != ':')
+        return fail(ps, "expected ':'");
+      if (!parseValue(ps, v.members[key]))
+        return false;
+      skipSpace(ps);
+      if (*ps.p == '}') {
+        ps.p++;
+        return true;
+      }
+      if (*ps.p++ != ',')
+        return fail(ps, "expected ',' or '}'");
+    }
+  }
+  if (*ps.p == '[') {
+    v.type = Json::ARRAY;
+    ps.p++;
+    skipSpace(ps);
+    if (*ps.p == ']') {
+      ps.p++;
+      return true;
+    }
+    for (;;) {
+      v.items.push_back(Json());
+      if (!parseValue(ps, v.items.back()))
+        return false;
+      skipSpace(ps);
+      if (*ps.p == ']') {
+        ps.p++;
+        return true;
+      }
+      if (*ps.p++ != ',')
+        return fail(ps, "expected ',' or ']'");
+    }
+  }
+  if (*ps.p == '"') {
+    v.type = Json::STRING;
+    return parseString(ps, v.text);
+  }
+  if (!strncmp(ps.p, "true", 4) || !strncmp(ps.p, "null", 4) || !strncmp(ps.p, "false", 5)) {
+    v.type = Json::LITERAL;
+    v.text = *ps.p == 'f' ? "false" : std::string(ps.p, 4);
+    ps.p += v.text.size();
+    return true;
+  }
+  char* end;
+  v.type = Json::NUMBER;
+  v.number = strtod(ps.p, &end);
+  if (end == ps.p)
+    return fail(ps, "unexpected character");
+  ps.p = end;
+  return true;
+}
+
+/* An array of exactly n numbers */
+static bool readNumbers (const Json& v, int n, float* out)
+{
+  if (v.type != Json::ARRAY || (int)v.items.size() != n)
+    return false;
+  for (int i = 0; i < n; i++) {
+    if (v.items[i].type != Json::NUMBER)
+      return false;
+    out[i] = v.items[i].number;
+  }
+  return true;
+}
+
+static const Json* member (const Json& v, const char* key)
+{
+  std::map<std::string, Json>::const_iterator it = v.members.find(key);
+  return it == v.members.end() ? NULL : &it->second;
+}
+
+static bool readNumber (const Json& v, const char* key, float* out)
+{
+  const Json* m = member(v, key);
+  if (!m || m->type != Json::NUMBER)
+    return false;
+  *out = m->number;
+  return true;
+}
+
+/* A list of [x, y] points into xyz triples */
+static bool readPoints (const Json* v, std::vector<float>& xyz)
+{
+  if (!v || v->type != Json::ARRAY)
+    return false;
+  for (size_t i = 0; i < v->items.size(); i++) {
+    float p[2];
+    if (!readNumbers(v->items[i], 2, p))
+      return false;
+    xyz.push_back(p[0]);
+    xyz.push_back(p[1]);
+    xyz.push_back(0);
+  }
+  return true;
+}
+
+static bool compile (const Json& level, const char* output)
+{
+  std::vector<Target> targets;
+  std::vector<float> target_colors;
+  std::vector<Polygon> obstacles;
+  std::vector<float> vertices, colors;
+
+  const Json* list = member(level, "targets");
+  for (size_t i = 0; list && i < list->items.size(); i++) {
+    const Json& t = list->items[i];
+    Target target;
+    float color[3] = { 1, 1, 1 };
+    const Json* c = member(t, "color");
+    if (!readNumber(t, "x", &target.x) || !readNumber(t, "y", &target.y) || !readNumber(t, "radius", &target.radius) ||
+        target.radius <= 0 || (c && !readNumbers(*c, 3, color))) {
+      std::cerr << "levelc: targets[" << i << "] needs x, y, a positive radius and an [r, g, b] color\n";
+      return false;
+    }
+    targets.push_back(target);
+    target_colors.insert(target_colors.end(), color, color + 3);
+  }
+
+  list = member(level, "obstacles");
+  for (size_t i = 0; list && i < list->items.size(); i++) {
+    const Json& o = list->items[i];
+    std::vector<float> corners, shape_colors;
+    bool ok;
+    if (member(o, "outline")) {
+      float color[3] = { 1, 1, 1 };
+      const Json* c = member(o, "color");
+      ok = readPoints(member(o, "outline"), corners) && corners.size() >= 9 && (!c || readNumbers(*c, 3, color));
+      // Fan around the first corner
+      std::vector<float> fan;
+      for (size_t k = 2; ok && k < corners.size() / 3; k++) {
+        size_t corner[3] = { 0, k - 1, k };
+        for (int j = 0; j < 3; j++) {
+          fan.insert(fan.end(), &corners[3 * corner[j]], &corners[3 * corner[j]] + 3);
+          shape_colors.insert(shape_colors.end(), color, color + 3);
+        }
+      }
+      corners.swap(fan);
+    }
+    else {
+      const Json* c = member(o, "colors");
+      ok = readPoints(member(o, "triangles"), corners) && corners.size() >= 9 && corners.size() % 9 == 0 &&
+           c && c->items.size() == corners.size() / 3;
+      for (size_t k = 0; ok && k < corners.size() / 3; k++) {
+        float color[3];
+        ok = readNumbers(c->items[k], 3, color);
+        shape_colors.insert(shape_colors.end(), color, color + 3);
+      }
+    }
+    if (!ok) {
+      std::cerr << "levelc: obstacles[" << i << "] needs an outline of at least 3 [x, y] points and an optional color, "
+                << "or triangles and a color per corner\n";
+      return false;
+    }
+    Polygon polygon;
+    if (!polygon_from_vertices(&corners[0], corners.size() / 3, 0, 0, polygon)) {
+      std::cerr << "levelc: obstacles[" << i << "] has a hull of more than " << MAX_POLYGON_VERTICES << " corners or no area\n";
+      return false;
+    }
+    obstacles.push_back(polygon);
+    vertices.insert(vertices.end(), corners.begin(), corners.end());
+    colors.insert(colors.end(), shape_colors.begin(), shape_colors.end());
+  }
+
+  if (!level_write(output, targets, target_colors, obstacles, vertices, colors))
+    return false;
+  std::cout << output << ": " << targets.size() << " targets, " << obstacles.size() << " obstacles, "
+            << vertices.size() / 3 << " vertices\n";
+  return true;
+}
+
+int main (int argc, char** argv)
+{
+  if (argc != 3) {
+    std::cerr << "usage: levelc level.json level.lvl\n";
+    return EXIT_FAILURE;
+  }
+  FILE* fp = fopen(argv[1], "rb");
+  if (!fp) {
+    std::cerr << "levelc: could not open " << argv[1] << '\n';
+    return EXIT_FAILURE;
+  }
+  std::string text;
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    text.append(buffer, n);
+  fclose(fp);
+
+  Parser ps = { text.c_str(), text.c_str(), NULL };
+  Json level;
+  bool ok = parseValue(ps, level);
+  skipSpace(ps);
+  if (ok && *ps.p)
+    ok = fail(ps, "trailing characters");
+  if (!ok || level.type != Json::OBJECT) {
+    int line = 1;
+    for (const char* c = ps.start; c < ps.p; c++)
+      line += *c == '\n';
+    std::cerr << "levelc: " << argv[1] << ":" << line << ": " << (ps.error ? ps.error : "expected an object") << '\n';
+    return EXIT_FAILURE;
+  }
+  return compile(level, argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "loader.h"
+#include "spsc.h"
+#include "trace.h"
+
+// Obstacle vertices per mesh, whole triangles
+#define CHUNK_VERTICES (3 * 4096)
+// Meshes built ahead of the uploads
+#define QUEUE_SIZE 64
+
+static SpscRing<LevelMesh*> ready(QUEUE_SIZE);
+static std::thread loader;
+static std::atomic<bool> finished(false);
+static std::atomic<bool> stopping(false);
+static Level loading;
+
+/* Waits for room in the queue, false when stopped meanwhile */
+static bool hand_over (LevelMesh* mesh)
+{
+  while (!ready.push(mesh)) {
+    if (stopping.load(std::memory_order_relaxed)) {
+      delete mesh;
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+void loader_circle (LevelMesh* mesh, const float* color)
+{
+  float PI = 3.141592654;
+  mesh->vertices.resize(3 * CIRCLE_POINTS);
+  mesh->colors.resize(3 * CIRCLE_POINTS);
+  for (int i = 0; i < 3 * CIRCLE_POINTS; ) {
+    float angle = PI * i / CIRCLE_POINTS;
+    mesh->vertices[i++] = (float)cos(angle);
+    mesh->vertices[i++] = (float)sin(angle);
+    mesh->vertices[i++] = 0;
+  }
+  for (int i = 0; i < 3 * CIRCLE_POINTS; i += 3)
+    memcpy(&mesh->colors[i], color, 3 * sizeof(float));
+}
+
+static void loader_main ()
+{
+  trace_thread_name("loader");
+  TraceScope trace("build level meshes");
+  const Level& level = loading;
+  const LevelHeader& h = *level.header;
+
+  // Fault the whole file in here rather than in the middle of an upload
+  madvise(level.data, level.size, MADV_WILLNEED);
+  long page = sysconf(_SC_PAGESIZE);
+  volatile unsigned char touch = 0;
+  for (size_t offset = 0; offset < level.size; offset += page)
+    touch += ((const unsigned char*) level.data)[offset];
+
+  // Targets of the same color share a circle
+  std::map< std::vector<float>, LevelMesh* > looks;
+  std::vector<LevelMesh*> circles;
+  for (unsigned int t = 0; t < h.target_count; t++) {
+    const float* color = &level.target_colors[3 * t];
+    LevelMesh*& mesh = looks[std::vector<float>(color, color + 3)];
+    if (!mesh) {
+      mesh = new LevelMesh;
+      mesh->kind = MESH_TARGET;
+      mesh->chunk = -1;
+      loader_circle(mesh, color);
+      circles.push_back(mesh);
+    }
+    mesh->targets.push_back(t);
+  }
+  for (size_t i = 0; i < circles.size(); i++) {
+    if (!hand_over(circles[i])) {
+      for (i++; i < circles.size(); i++)
+        delete circles[i];
+      return;
+    }
+  }
+
+  for (unsigned int first = 0, chunk = 0; first < h.vertex_count; first += CHUNK_VERTICES, chunk++) {
+    unsigned int count = h.vertex_count - first < CHUNK_VERTICES ? h.vertex_count - first : CHUNK_VERTICES;
+    LevelMesh* mesh = new LevelMesh;
+    mesh->kind = MESH_OBSTACLES;
+    mesh->chunk = chunk;
+    mesh->vertices.assign(level.vertices + 3 * first, level.vertices + 3 * (first + count));
+    mesh->colors.assign(level.colors + 3 * first, level.colors + 3 * (first + count));
+    if (!hand_over(mesh))
+      return;
+  }
+  finished.store(true, std::memory_order_release);
+}
+
+void loader_start (const Level& level)
+{
+  loader_stop();
+  loading = level;
+  finished.store(false);
+  stopping.store(false);
+  loader = std::thread(loader_main);
+}
+
+LevelMesh* loader_pop ()
+{
+  LevelMesh* mesh;
+  return ready.pop(mesh) ? mesh : NULL;
+}
+
+bool loader_done ()
+{
+  return finished.load(std::memory_order_acquire) && ready.empty();
+}
+
+int loader_chunks (const Level& level)
+{
+  return (level.header->vertex_count + CHUNK_VERTICES - 1) / CHUNK_VERTICES;
+}
+
+void loader_stop ()
+{
+  if (!loader.joinable())
+    return;
+  stopping.store(true);
+  loader.join();
+  LevelMesh* mesh;
+  while (ready.pop(mesh))
+    delete mesh;
+}
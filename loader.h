@@ -0,0 +1,44 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "level.h"
+
+/* Builds the meshes of a level on a loader thread: pages the mapped file
+   in, cuts the obstacle triangles into chunks and makes one circle per
+   target color. Finished meshes wait in a lock-free queue until the GL
+   thread uploads them, a few per frame, so a big level never stalls a
+   frame. The level has to stay mapped until the loader is stopped. */
+
+enum LevelMeshKind {
+  MESH_OBSTACLES,   // GL_TRIANGLES, a chunk of the obstacle mesh
+  MESH_TARGET       // GL_TRIANGLE_FAN, circle of radius 1
+};
+
+struct LevelMesh {
+  LevelMeshKind kind;
+  int chunk;                     // obstacle chunk number
+  std::vector<int> targets;      // targets drawn with this circle
+  std::vector<float> vertices;   // xyz
+  std::vector<float> colors;     // rgb
+
+  size_t bytes () const { return (vertices.size() + colors.size()) * sizeof(float); }
+};
+
+void loader_start (const Level& level);
+/* Next finished mesh, the caller deletes it. NULL if none is ready yet. */
+LevelMesh* loader_pop ();
+/* Every mesh has been popped */
+bool loader_done ();
+/* Obstacle chunks a level is cut into */
+int loader_chunks (const Level& level);
+void loader_stop ();
+
+// Corners of a target circle
+#define CIRCLE_POINTS 100
+/* Unit circle fan in one color, the same as the other circles of the game */
+void loader_circle (LevelMesh* mesh, const float* color);
+
+#endif
@@ -0,0 +1,119 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+#include "pacing.h"
+
+// Sleeping is only trusted up to this close to the deadline
+#define SPIN_SECONDS 0.002
+// Low latency mode aims to be done this long before the refresh
+#define LATENCY_MARGIN 0.001
+// Weight of the newest frame in the running estimates
+#define ESTIMATE_WEIGHT 0.1
+
+static PacingMode mode = PACING_VSYNC;
+static const char* mode_names[] = { "vsync", "adaptive", "uncapped", "cap", "low-latency" };
+static double fps = 60;
+
+static double frame_start = -1;   // when the current frame left pacing_wait()
+static double last_end = -1;      // when the last swap returned
+static double deadline = -1;      // when the next capped frame may start
+static double work = 0;           // estimated seconds from frame start to swap
+static double period = 0;         // estimated seconds between swaps
+
+// Frame time statistics, Welford's running variance
+static long frames = 0;
+static double mean = 0, m2 = 0, longest = 0;
+
+bool pacing_set_mode (const char* name)
+{
+  for (int i = 0; i < (int)(sizeof(mode_names) / sizeof(mode_names[0])); i++) {
+    if (!strcmp(name, mode_names[i])) {
+      mode = (PacingMode) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool pacing_set_fps (double value)
+{
+  if (!(value > 0) || std::isinf(value))
+    return false;
+  fps = value;
+  return true;
+}
+
+void pacing_init ()
+{
+  int interval = 1;
+  if (mode == PACING_UNCAPPED || mode == PACING_CAP)
+    interval = 0;
+  else if (mode == PACING_ADAPTIVE) {
+    if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+      interval = -1;
+    else
+      std::cerr << "No adaptive vsync on this driver, using vsync\n";
+  }
+  glfwSwapInterval(interval);
+}
+
+/* Sleeps most of the way to 'until', spins the rest */
+static void wait_until (double until)
+{
+  double left = until - glfwGetTime();
+  if (left > SPIN_SECONDS)
+    std::this_thread::sleep_for(std::chrono::duration<double>(left - SPIN_SECONDS));
+  while (glfwGetTime() < until)
+    ;
+}
+
+void pacing_wait ()
+{
+  if (mode == PACING_CAP) {
+    double now = glfwGetTime();
+    // Fell behind by more than a frame: start over rather than rush to catch up
+    if (deadline < 0 || now - deadline > 1 / fps)
+      deadline = now;
+    wait_until(deadline);
+    deadline += 1 / fps;
+  }
+  else if (mode == PACING_LOW_LATENCY && last_end >= 0 && period > 0)
+    wait_until(last_end + period - work - LATENCY_MARGIN);
+  frame_start = glfwGetTime();
+}
+
+void pacing_swap ()
+{
+  double w = glfwGetTime() - frame_start;
+  work = work > 0 ? work + (w - work) * ESTIMATE_WEIGHT : w;
+}
+
+void pacing_end ()
+{
+  double now = glfwGetTime();
+  if (last_end >= 0) {
+    double frame = now - last_end;
+    period = period > 0 ? period + (frame - period) * ESTIMATE_WEIGHT : frame;
+    frames++;
+    double delta = frame - mean;
+    mean += delta / frames;
+    m2 += delta * (frame - mean);
+    if (frame > longest)
+      longest = frame;
+  }
+  last_end = now;
+}
+
+void pacing_report ()
+{
+  if (frames == 0)
+    return;
+  double deviation = frames > 1 ? std::sqrt(m2 / (frames - 1)) : 0;
+  std::cerr << frames << " frames (" << mode_names[mode] << "): " << mean * 1000 << " ms mean, "
+            << deviation * 1000 << " ms deviation, " << longest * 1000 << " ms longest\n";
+}
@@ -0,0 +1,35 @@
+#ifndef PACING_H
+#define PACING_H
+
+/* Frame pacing of the windowed game. The loop calls pacing_wait() before
+   it polls input, pacing_swap() right before swapping and pacing_end()
+   after, the module holds frames back as the mode asks and keeps
+   statistics of the frame times.
+
+   vsync        one frame per refresh (the default)
+   adaptive     vsync, but a late frame tears instead of waiting for the
+                next refresh, where the driver supports it
+   uncapped     as fast as it goes
+   cap          at most --fps frames per second: sleeps, then spins for
+                the last stretch, which sleep is too coarse for
+   low-latency  vsync, with the frame started as late as it can be and
+                still make the refresh, so the input it draws is fresh */
+
+enum PacingMode { PACING_VSYNC, PACING_ADAPTIVE, PACING_UNCAPPED, PACING_CAP, PACING_LOW_LATENCY };
+
+/* False for an unknown name */
+bool pacing_set_mode (const char* name);
+/* False unless 'fps' is positive and finite */
+bool pacing_set_fps (double fps);
+/* Once the GL context is current */
+void pacing_init ();
+
+void pacing_wait ();
+void pacing_swap ();
+void pacing_end ();
+
+/* Frame count, mean and standard deviation of the frame time and the
+   longest frame, on stderr */
+void pacing_report ();
+
+#endif
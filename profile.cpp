@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "render.h"
+#include "profile.h"
+#include "trace.h"
+
+static const char* names[PROFILE_SECTIONS] = { "physics", "poll", "transforms", "scene", "targets", "balls", "swap" };
+// Sections that issue GL commands
+static const bool gpu_timed[PROFILE_SECTIONS] = { false, false, false, true, true, true, false };
+
+/* Last PROFILE_WINDOW samples of a section, in milliseconds */
+struct Samples {
+  double values[PROFILE_WINDOW];
+  int count, next;
+};
+
+static std::atomic<bool> enabled(false);
+static std::mutex samples_mutex;
+static Samples cpu[PROFILE_SECTIONS], gpu[PROFILE_SECTIONS];
+
+// Each only touched by the thread running its section
+static std::chrono::steady_clock::time_point started[PROFILE_SECTIONS];
+static bool running[PROFILE_SECTIONS];
+
+// GPU side: a query per section for every frame in flight
+static bool use_gpu = false;
+static GLuint queries[PROFILE_LATENCY][PROFILE_SECTIONS];
+static bool issued[PROFILE_LATENCY][PROFILE_SECTIONS];
+static int slot = 0;
+
+static double log_every = 0;
+static std::chrono::steady_clock::time_point last_log;
+
+static void add (Samples& s, double ms)
+{
+  std::lock_guard<std::mutex> lock(samples_mutex);
+  s.values[s.next] = ms;
+  s.next = (s.next + 1) % PROFILE_WINDOW;
+  if (s.count < PROFILE_WINDOW)
+    s.count++;
+}
+
+void profile_init (bool with_gpu)
+{
+  use_gpu = with_gpu;
+  if (use_gpu)
+    glGenQueries(PROFILE_LATENCY * PROFILE_SECTIONS, &queries[0][0]);
+  last_log = std::chrono::steady_clock::now();
+}
+
+void profile_shutdown ()
+{
+  if (use_gpu)
+    glDeleteQueries(PROFILE_LATENCY * PROFILE_SECTIONS, &queries[0][0]);
+  use_gpu = false;
+}
+
+void profile_enable (bool on)
+{
+  enabled = on;
+}
+
+bool profile_enabled ()
+{
+  return enabled;
+}
+
+void profile_log_every (double seconds)
+{
+  log_every = seconds;
+}
+
+void profile_begin (ProfileSection s)
+{
+  trace_begin(names[s]);
+  if (!enabled.load(std::memory_order_relaxed))
+    return;
+  running[s] = true;
+  if (use_gpu && gpu_timed[s])
+    glBeginQuery(GL_TIME_ELAPSED, queries[slot][s]);
+  started[s] = std::chrono::steady_clock::now();
+}
+
+void profile_end (ProfileSection s)
+{
+  trace_end(names[s]);
+  if (!running[s])
+    return;
+  running[s] = false;
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started[s]).count();
+  if (use_gpu && gpu_timed[s]) {
+    glEndQuery(GL_TIME_ELAPSED);
+    issued[slot][s] = true;
+  }
+  add(cpu[s], ms);
+}
+
+static void logStats ()
+{
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(3);
+  for (int s = 0; s < PROFILE_SECTIONS; s++) {
+    ProfileStats c, g;
+    if (!profile_stats((ProfileSection) s, false, c))
+      continue;
+    line << (line.tellp() ? ", " : "profile: ") << names[s] << ' ' << c.min << '/' << c.avg << '/' << c.p99;
+    if (profile_stats((ProfileSection) s, true, g))
+      line << " (gpu " << g.min << '/' << g.avg << '/' << g.p99 << ')';
+  }
+  if (line.tellp())
+    std::cerr << line.str() << " ms min/avg/p99\n";
+}
+
+void profile_frame ()
+{
+  if (use_gpu) {
+    // This slot's queries went out PROFILE_LATENCY frames ago, one still
+    // not done is dropped rather than waited for
+    slot = (slot + 1) % PROFILE_LATENCY;
+    for (int s = 0; s < PROFILE_SECTIONS; s++) {
+      if (!issued[slot][s])
+        continue;
+      issued[slot][s] = false;
+      GLint available = 0;
+      glGetQueryObjectiv(queries[slot][s], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available) {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[slot][s], GL_QUERY_RESULT, &ns);
+        add(gpu[s], ns / 1e6);
+      }
+    }
+  }
+
+  if (log_every > 0 && enabled) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - last_log).count() >= log_every) {
+      last_log = now;
+      logStats();
+    }
+  }
+}
+
+const char* profile_name (ProfileSection s)
+{
+  return names[s];
+}
+
+bool profile_stats (ProfileSection s, bool from_gpu, ProfileStats& out)
+{
+  std::vector<double> values;
+  {
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    const Samples& samples = from_gpu ? gpu[s] : cpu[s];
+    values.assign(samples.values, samples.values + samples.count);
+  }
+  out.samples = values.size();
+  if (values.empty())
+    return false;
+  std::sort(values.begin(), values.end());
+  double sum = 0;
+  for (size_t i = 0; i < values.size(); i++)
+    sum += values[i];
+  out.min = values[0];
+  out.avg = sum / values.size();
+  out.p99 = values[(size_t)std::ceil(0.99 * values.size()) - 1];
+  return true;
+}
@@ -0,0 +1,60 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* Where the frame time goes. Each section is timed on the CPU and, if it
+   issues GL commands, on the GPU with GL_TIME_ELAPSED queries. Their
+   results are read back PROFILE_LATENCY frames later, by which time they
+   are done, so the CPU never waits for the GPU. Every section keeps its
+   last PROFILE_WINDOW samples for rolling min, average and 99th
+   percentile. Off until profile_enable(), then a marker costs a clock
+   read and a lock. Sections are spans of the trace as well. */
+
+#define PROFILE_LATENCY 4
+#define PROFILE_WINDOW 256
+
+enum ProfileSection {
+  PROFILE_PHYSICS,      // the steps of a frame, on the job system
+  PROFILE_POLL,         // glfwPollEvents / glfwWaitEventsTimeout
+  PROFILE_TRANSFORMS,   // transform_update
+  PROFILE_SCENE,        // obstacles and the cannon
+  PROFILE_TARGETS,
+  PROFILE_BALLS,
+  PROFILE_SWAP,         // glfwSwapBuffers
+  PROFILE_SECTIONS
+};
+
+struct ProfileStats {
+  int samples;
+  double min, avg, p99;   // milliseconds
+};
+
+/* With 'gpu' on the thread that has the GL context, which the GPU timed
+   sections must run on from then on */
+void profile_init (bool gpu);
+void profile_shutdown ();
+
+void profile_enable (bool on);
+bool profile_enabled ();
+/* Every 'seconds' profile_frame() logs the stats to stderr, 0 never */
+void profile_log_every (double seconds);
+
+/* A section runs on one thread at a time. An end without its begin,
+   as when profiling was turned on in between, is ignored. */
+void profile_begin (ProfileSection s);
+void profile_end (ProfileSection s);
+
+/* After each frame, on the thread with the GL context: collects the
+   GPU times that have come in and logs when it is time */
+void profile_frame ();
+
+const char* profile_name (ProfileSection s);
+/* False while the section has no samples */
+bool profile_stats (ProfileSection s, bool gpu, ProfileStats& out);
+
+struct ProfileScope {
+  ProfileSection section;
+  explicit ProfileScope (ProfileSection s) : section(s) { profile_begin(s); }
+  ~ProfileScope () { profile_end(section); }
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "projectiles.h"
+
+// A handle is the index in the handle tables plus a generation in the top bits
+#define HANDLE_INDEX_BITS 24
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+
+void projectiles_init (Projectiles& p, int capacity)
+{
+  if (capacity > (int)HANDLE_INDEX_MASK)
+    capacity = HANDLE_INDEX_MASK;
+  p.capacity = capacity;
+  p.x.assign(capacity, 0);
+  p.y.assign(capacity, 0);
+  p.vx.assign(capacity, 0);
+  p.vy.assign(capacity, 0);
+  p.px.assign(capacity, 0);
+  p.py.assign(capacity, 0);
+  p.life.assign(capacity, 0);
+  p.alive.assign(capacity, 0);
+  p.bounced.assign(capacity, 0);
+  p.handle.assign(capacity, NO_PROJECTILE);
+  p.slot.assign(capacity, -1);
+  p.generation.assign(capacity, 0);
+  projectiles_clear(p);
+}
+
+void projectiles_clear (Projectiles& p)
+{
+  p.count = 0;
+  p.free_handles.clear();
+  // Lowest handles come out first
+  for (int i = p.capacity - 1; i >= 0; i--) {
+    p.slot[i] = -1;
+    p.free_handles.push_back(i);
+  }
+}
+
+ProjectileHandle projectiles_spawn (Projectiles& p, float x, float y, float vx, float vy, float life)
+{
+  if (p.free_handles.empty())
+    return NO_PROJECTILE;
+  int index = p.free_handles.back();
+  p.free_handles.pop_back();
+
+  int i = p.count++;
+  ProjectileHandle h = index | (p.generation[index] << HANDLE_INDEX_BITS);
+  p.slot[index] = i;
+  p.handle[i] = h;
+  p.x[i] = p.px[i] = x;
+  p.y[i] = p.py[i] = y;
+  p.vx[i] = vx;
+  p.vy[i] = vy;
+  p.life[i] = life;
+  p.alive[i] = 1;
+  p.bounced[i] = 0;
+  return h;
+}
+
+int projectiles_find (const Projectiles& p, ProjectileHandle h)
+{
+  if (h == NO_PROJECTILE)
+    return -1;
+  int i = p.slot[h & HANDLE_INDEX_MASK];
+  return i >= 0 && p.handle[i] == h ? i : -1;
+}
+
+void projectiles_kill (Projectiles& p, ProjectileHandle h)
+{
+  int i = projectiles_find(p, h);
+  if (i >= 0)
+    p.alive[i] = 0;
+}
+
+/* Move the last ball into slot i */
+static void removeSlot (Projectiles& p, int i)
+{
+  unsigned int index = p.handle[i] & HANDLE_INDEX_MASK;
+  p.slot[index] = -1;
+  p.generation[index] = (p.generation[index] + 1) & (0xffffffffu >> HANDLE_INDEX_BITS);
+  p.free_handles.push_back(index);
+
+  int last = --p.count;
+  if (i != last) {
+    p.x[i] = p.x[last];
+    p.y[i] = p.y[last];
+    p.vx[i] = p.vx[last];
+    p.vy[i] = p.vy[last];
+    p.px[i] = p.px[last];
+    p.py[i] = p.py[last];
+    p.life[i] = p.life[last];
+    p.alive[i] = p.alive[last];
+    p.bounced[i] = p.bounced[last];
+    p.handle[i] = p.handle[last];
+    p.slot[p.handle[i] & HANDLE_INDEX_MASK] = i;
+  }
+}
+
+void projectiles_compact (Projectiles& p)
+{
+  // Backwards, so whatever is swapped into slot i has been looked at already
+  for (int i = p.count - 1; i >= 0; i--)
+    if (!p.alive[i])
+      removeSlot(p, i);
+}
@@ -0,0 +1,42 @@
+#ifndef PROJECTILES_H
+#define PROJECTILES_H
+
+#include <vector>
+
+/* Pool of balls in flight, one array per field so the update loops stream
+   through memory. Live balls are always packed in [0, count): a dead ball
+   is swapped with the last one. Handles stay valid across those moves and
+   go stale once their ball is removed. */
+
+typedef unsigned int ProjectileHandle;
+#define NO_PROJECTILE 0xffffffffu
+
+struct Projectiles {
+  int count;
+  int capacity;
+  std::vector<float> x, y, vx, vy;
+  std::vector<float> px, py;          // positions at the previous step, for interpolation
+  std::vector<float> life;            // seconds left
+  std::vector<unsigned char> alive;   // cleared by the update, dead balls go at the next compact
+  std::vector<unsigned char> bounced; // walls hit during the last step: 1 left/right, 2 bottom/top
+
+  // handle <-> slot mapping
+  std::vector<ProjectileHandle> handle;   // per slot
+  std::vector<int> slot;                  // per handle index, -1 when free
+  std::vector<unsigned int> generation;   // per handle index, bumped on every reuse
+  std::vector<int> free_handles;
+};
+
+/* Storage for 'capacity' balls is allocated once, spawning never reallocates */
+void projectiles_init (Projectiles& p, int capacity);
+void projectiles_clear (Projectiles& p);
+
+/* NO_PROJECTILE when the pool is full */
+ProjectileHandle projectiles_spawn (Projectiles& p, float x, float y, float vx, float vy, float life);
+/* Slot of a ball, -1 if the handle is stale */
+int projectiles_find (const Projectiles& p, ProjectileHandle h);
+void projectiles_kill (Projectiles& p, ProjectileHandle h);
+/* Removes every ball whose alive flag is cleared */
+void projectiles_compact (Projectiles& p);
+
+#endif
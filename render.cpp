@@ -0,0 +1,255 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+
+#include "render.h"
+#include "soft_raster.h"
+#include "trace.h"
+
+using namespace glm;
+
+GLMatrices Matrices;
+
+GLuint programID;
+
+RenderBackend render_backend = BACKEND_GL;
+RenderStats render_stats = { 0, 0 };
+
+/* MVP of the next software draw, glUniformMatrix4fv equivalent */
+static mat4 soft_mvp(1.0f);
+
+/* Function to load Shaders - Use it as it is */
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
+	TraceScope trace("load shaders");
+
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
+	// Read the Vertex Shader code from the file
+	std::string VertexShaderCode;
+	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
+	if(VertexShaderStream.is_open())
+	{
+		std::string Line = "";
+		while(getline(VertexShaderStream, Line))
+			VertexShaderCode += "\n" + Line;
+		VertexShaderStream.close();
+	}
+
+	// Read the Fragment Shader code from the file
+	std::string FragmentShaderCode;
+	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
+	if(FragmentShaderStream.is_open()){
+		std::string Line = "";
+		while(getline(FragmentShaderStream, Line))
+			FragmentShaderCode += "\n" + Line;
+		FragmentShaderStream.close();
+	}
+
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+
+	// Compile Vertex Shader
+	fprintf(stderr, "Compiling shader : %s\n", vertex_file_path);
+	char const * VertexSourcePointer = VertexShaderCode.c_str();
+	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
+	glCompileShader(VertexShaderID);
+
+	// Check Vertex Shader
+	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	std::vector<char> VertexShaderErrorMessage(InfoLogLength);
+	glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
+	fprintf(stderr, "%s\n", &VertexShaderErrorMessage[0]);
+
+	// Compile Fragment Shader
+	fprintf(stderr, "Compiling shader : %s\n", fragment_file_path);
+	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
+	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
+	glCompileShader(FragmentShaderID);
+
+	// Check Fragment Shader
+	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	std::vector<char> FragmentShaderErrorMessage(InfoLogLength);
+	glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
+	fprintf(stderr, "%s\n", &FragmentShaderErrorMessage[0]);
+
+	// Link the program
+	fprintf(stderr, "Linking program\n");
+	GLuint ProgramID = glCreateProgram();
+	glAttachShader(ProgramID, VertexShaderID);
+	glAttachShader(ProgramID, FragmentShaderID);
+	glLinkProgram(ProgramID);
+
+	// Check the program
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	std::vector<char> ProgramErrorMessage( max(InfoLogLength, int(1)) );
+	glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+	fprintf(stderr, "%s\n", &ProgramErrorMessage[0]);
+
+	glDeleteShader(VertexShaderID);
+	glDeleteShader(FragmentShaderID);
+
+	return ProgramID;
+}
+
+/* Generate VAO, VBOs and return VAO handle */
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode)
+{
+  struct VAO* vao = new struct VAO;
+  vao->PrimitiveMode = primitive_mode;
+  vao->NumVertices = numVertices;
+  vao->FillMode = fill_mode;
+  vao->Vertices = NULL;
+  vao->Colors = NULL;
+
+  if (render_backend == BACKEND_SOFTWARE) {
+    // No GL context at all, keep our own copy of the buffers instead
+    vao->VertexArrayID = vao->VertexBuffer = vao->ColorBuffer = 0;
+    vao->Vertices = new GLfloat [3*numVertices];
+    vao->Colors = new GLfloat [3*numVertices];
+    memcpy(vao->Vertices, vertex_buffer_data, 3*numVertices*sizeof(GLfloat));
+    memcpy(vao->Colors, color_buffer_data, 3*numVertices*sizeof(GLfloat));
+    return vao;
+  }
+
+    // Create Vertex Array Object
+    // Should be done after CreateWindow and before any other GL calls
+    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
+    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
+    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+
+    glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
+    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
+    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    glVertexAttribPointer(
+                          0,                  // attribute 0. Vertices
+                          3,                  // size (x,y,z)
+                          GL_FLOAT,           // type
+                          GL_FALSE,           // normalized?
+                          0,                  // stride
+                          (void*)0            // array buffer offset
+                          );
+
+    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
+    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
+    glVertexAttribPointer(
+                          1,                  // attribute 1. Color
+                          3,                  // size (r,g,b)
+                          GL_FLOAT,           // type
+                          GL_FALSE,           // normalized?
+                          0,                  // stride
+                          (void*)0            // array buffer offset
+                          );
+
+    return vao;
+  }
+
+/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
+  struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode)
+  {
+    GLfloat* color_buffer_data = new GLfloat [3*numVertices];
+    for (int i=0; i<numVertices; i++) {
+      color_buffer_data [3*i] = red;
+      color_buffer_data [3*i + 1] = green;
+      color_buffer_data [3*i + 2] = blue;
+    }
+
+    struct VAO* vao = create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+    // Both backends keep their own copy of the colors
+    delete [] color_buffer_data;
+    return vao;
+  }
+
+/* Render the VBOs handled by VAO */
+  void draw3DObject (struct VAO* vao)
+  {
+    render_stats.draws++;
+    render_stats.vertices += vao->NumVertices;
+    if (render_backend == BACKEND_SOFTWARE) {
+      sr_draw(&soft_mvp[0][0], vao->PrimitiveMode, vao->Vertices, vao->Colors, vao->NumVertices);
+      return;
+    }
+
+    // Change the Fill Mode for this object
+    glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+
+    // Bind the VAO to use
+    glBindVertexArray (vao->VertexArrayID);
+
+    // Enable Vertex Attribute 0 - 3d Vertices
+    glEnableVertexAttribArray(0);
+    // Bind the VBO to use
+    glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
+
+    // Enable Vertex Attribute 1 - Color
+    glEnableVertexAttribArray(1);
+    // Bind the VBO to use
+    glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+
+    // Draw the geometry !
+    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+  }
+
+void destroy3DObject (struct VAO* vao)
+{
+  if (render_backend == BACKEND_GL) {
+    glDeleteBuffers(1, &vao->VertexBuffer);
+    glDeleteBuffers(1, &vao->ColorBuffer);
+    glDeleteVertexArrays(1, &vao->VertexArrayID);
+  }
+  delete [] vao->Vertices;
+  delete [] vao->Colors;
+  delete vao;
+}
+
+/* Bind the shader program used by every object */
+void useProgram ()
+{
+  if (render_backend == BACKEND_GL)
+    glUseProgram (programID);
+}
+
+/* Set the MVP uniform for the following draw3DObject calls */
+void setMVP (const mat4& MVP)
+{
+  if (render_backend == BACKEND_SOFTWARE)
+    soft_mvp = MVP;
+  else
+    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+}
+
+void setViewport (int width, int height)
+{
+  if (render_backend == BACKEND_SOFTWARE)
+    sr_viewport(width, height);
+  else
+    glViewport (0, 0, (GLsizei) width, (GLsizei) height);
+}
+
+void setClearColor (float r, float g, float b, float a)
+{
+  if (render_backend == BACKEND_SOFTWARE)
+    sr_clear_color(r, g, b, a);
+  else
+    glClearColor (r, g, b, a);
+}
+
+void clearFrame ()
+{
+  if (render_backend == BACKEND_SOFTWARE)
+    sr_clear();
+  else
+    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+/* The software backend only bins triangles in draw3DObject, rasterize them now */
+void finishFrame ()
+{
+  if (render_backend == BACKEND_SOFTWARE)
+    sr_finish();
+}
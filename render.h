@@ -0,0 +1,63 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <glad/glad.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+struct VAO {
+  GLuint VertexArrayID;
+  GLuint VertexBuffer;
+  GLuint ColorBuffer;
+
+  GLenum PrimitiveMode;
+  GLenum FillMode;
+  int NumVertices;
+
+  // CPU side copies, only kept for the software backend
+  GLfloat* Vertices;
+  GLfloat* Colors;
+};
+typedef struct VAO VAO;
+
+struct GLMatrices {
+	glm::mat4 projection;
+	glm::mat4 model;
+	glm::mat4 view;
+	GLuint MatrixID;
+};
+extern GLMatrices Matrices;
+
+extern GLuint programID;
+
+/* Which backend create3DObject/draw3DObject talk to */
+enum RenderBackend {
+  BACKEND_GL,
+  BACKEND_SOFTWARE
+};
+extern RenderBackend render_backend;
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL);
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL);
+void draw3DObject (struct VAO* vao);
+/* Counted by draw3DObject on the drawing thread, whoever reads them zeroes them */
+struct RenderStats {
+  long draws;
+  long vertices;
+};
+extern RenderStats render_stats;
+/* Frees the buffers of either backend and the VAO itself */
+void destroy3DObject (struct VAO* vao);
+
+/* Backend independent replacements for the per frame GL state calls */
+void useProgram ();
+void setMVP (const glm::mat4& MVP);
+void setViewport (int width, int height);
+void setClearColor (float r, float g, float b, float a);
+void clearFrame ();
+void finishFrame ();
+
+#endif
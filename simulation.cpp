@@ -0,0 +1,581 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "simulation.h"
+#include "integrate.h"
+#include "jobs.h"
+#include "ccd.h"
+#include "bvh.h"
+#include "profile.h"
+
+// Pivot of the cannon and length of the barrel, as drawn in draw()
+#define PIVOT_X 1.0f
+#define PIVOT_Y 0.3f
+#define MUZZLE 0.86f
+
+// Degrees per second while C or P is held
+#define CANNON_TURN_RATE 300.0f
+
+// Never run more than this many steps in one frame, the game slows down instead
+#define MAX_STEPS_PER_FRAME 8
+
+// Seconds between the shots of a burst
+#define BURST_INTERVAL 0.1f
+// Degrees between the balls of a spread shot
+#define SPREAD_ANGLE 5.0f
+
+// Share of the speed into an obstacle a ball keeps on rebound
+static const float restitution = 0.95f;
+// Obstacle contacts of a ball in one step, and how far it is kept from them
+#define MAX_CONTACTS 4
+#define CONTACT_SLOP 1e-4f
+
+std::vector<Target> targets;
+
+// Grid of all targets, copied into every state on reset, and their BVH
+static UniformGrid target_grid;
+static Bvh target_bvh;
+static bool target_grid_built = false;
+
+std::vector<Polygon> obstacles;
+// Obstacles never move, every state shares their grid and BVH
+static UniformGrid obstacle_grid;
+static Bvh obstacle_bvh;
+static bool obstacle_grid_built = false;
+
+// Both broad phases are built for every level, this one is used
+static int broadphase = BROADPHASE_GRID;
+static const char* broadphase_names[] = { "grid", "bvh" };
+
+Controls controls = { false, 1, 6.0f, 1, 1, false };
+
+SimState sim;
+
+static double step_rate = 60;
+static double accumulator = 0;
+static double last_time = -1;
+
+void sim_reset (SimState& s, int capacity)
+{
+  s.tick = 0;
+  s.cannon_rotation = s.prev_rotation = 0;
+  s.burst_left = 0;
+  s.burst_wait = 0;
+  if (s.balls.capacity != capacity || s.balls.x.empty())
+    projectiles_init(s.balls, capacity);
+  else
+    projectiles_clear(s.balls);
+  s.hit.assign(targets.size(), 0);
+  s.score = 0;
+  if (!target_grid_built) {
+    std::vector<Box> boxes(targets.size());
+    for (size_t i = 0; i < targets.size(); i++)
+      boxes[i] = target_box(targets[i]);
+    grid_build(target_grid, boxes, BALL_RADIUS);
+    bvh_build(target_bvh, boxes, BALL_RADIUS);
+    target_grid_built = true;
+  }
+  s.grid = target_grid;
+  if (!obstacle_grid_built) {
+    std::vector<Box> boxes(obstacles.size());
+    for (size_t i = 0; i < obstacles.size(); i++)
+      boxes[i] = obstacles[i].box;
+    grid_build(obstacle_grid, boxes, BALL_RADIUS);
+    bvh_build(obstacle_bvh, boxes, BALL_RADIUS);
+    obstacle_grid_built = true;
+  }
+}
+
+void sim_set_targets (const std::vector<Target>& list)
+{
+  targets = list;
+  target_grid_built = false;
+}
+
+void sim_set_obstacles (const std::vector<Polygon>& list)
+{
+  obstacles = list;
+  obstacle_grid_built = false;
+}
+
+bool sim_set_broadphase (const char* name)
+{
+  for (int i = 0; i < 2; i++) {
+    if (!strcmp(name, broadphase_names[i])) {
+      broadphase = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* sim_broadphase_name ()
+{
+  return broadphase_names[broadphase];
+}
+
+void sim_muzzle (float cannon_rotation, float* x, float* y)
+{
+  float angle = cannon_rotation * M_PI / 180.0f;
+  *x = PIVOT_X - MUZZLE * std::sin(angle);
+  *y = PIVOT_Y + MUZZLE * std::cos(angle);
+}
+
+/* Balls per job of the parallel step */
+#define BALLS_PER_JOB 16384
+
+struct StepJob {
+  SimState* s;
+  IntegrateParams k;
+};
+
+struct TargetSweep {
+  const unsigned char* hit;
+  float x0, y0, dx, dy;
+  std::vector<int>* hits;
+};
+
+static void visitTarget (void* data, int j)
+{
+  TargetSweep& q = *(TargetSweep*) data;
+  const Target& t = targets[j];
+  float toi;
+  if (!q.hit[j] && sweep_circle_circle(q.x0, q.y0, q.dx, q.dy, t.x, t.y, t.radius + BALL_RADIUS, &toi))
+    q.hits->push_back(j);
+}
+
+/* Lists the targets a ball touches moving from (x0, y0) to (x1, y1).
+   Broad phase: the targets of the cells the segment's box covers, or of
+   the BVH leaves it crosses; narrow phase: swept circles. A target listed
+   in several cells can come up more than once, the merge drops repeats. */
+static inline void sweepTargets (const SimState& s, float x0, float y0, float x1, float y1, std::vector<int>& hits)
+{
+  float dx = x1 - x0, dy = y1 - y0;
+  if (broadphase == BROADPHASE_BVH) {
+    TargetSweep q = { &s.hit[0], x0, y0, dx, dy, &hits };
+    bvh_segment(target_bvh, x0, y0, x1, y1, visitTarget, &q);
+    return;
+  }
+
+  const UniformGrid& g = s.grid;
+  const GridShape& shape = g.shape;
+  const int* start = &g.start[0];
+  const int* count = &g.count[0];
+  const int* items = &g.items[0];
+  const Target* t = &targets[0];
+  int cx0, cy0, cx1, cy1;
+  grid_range(shape, std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1), &cx0, &cy0, &cx1, &cy1);
+  for (int cy = cy0; cy <= cy1; cy++) {
+    for (int cx = cx0; cx <= cx1; cx++) {
+      int c = cy * shape.nx + cx;
+      for (int k = start[c], last = start[c] + count[c]; k < last; k++) {
+        int j = items[k];
+        float toi;
+        if (sweep_circle_circle(x0, y0, dx, dy, t[j].x, t[j].y, t[j].radius + BALL_RADIUS, &toi))
+          hits.push_back(j);
+      }
+    }
+  }
+}
+
+struct ObstacleSweep {
+  float x0, y0, dx, dy;
+  bool found;
+  float t, nx, ny;
+};
+
+static void visitObstacle (void* data, int j)
+{
+  ObstacleSweep& q = *(ObstacleSweep*) data;
+  float toi, nx, ny;
+  if (sweep_circle_polygon(q.x0, q.y0, q.dx, q.dy, obstacles[j], BALL_RADIUS, &toi, &nx, &ny) && (!q.found || toi < q.t)) {
+    q.t = toi;
+    q.nx = nx;
+    q.ny = ny;
+    q.found = true;
+  }
+}
+
+/* Earliest obstacle the ball touches moving from (x0, y0) to (x1, y1),
+   through the same broad phase as the targets */
+static inline bool sweepObstacles (float x0, float y0, float x1, float y1, float* t, float* nx, float* ny)
+{
+  float dx = x1 - x0, dy = y1 - y0;
+  if (broadphase == BROADPHASE_BVH) {
+    ObstacleSweep q = { x0, y0, dx, dy, false, 0, 0, 0 };
+    bvh_segment(obstacle_bvh, x0, y0, x1, y1, visitObstacle, &q);
+    *t = q.t;
+    *nx = q.nx;
+    *ny = q.ny;
+    return q.found;
+  }
+
+  const UniformGrid& g = obstacle_grid;
+  const GridShape& shape = g.shape;
+  float min_x = std::min(x0, x1), min_y = std::min(y0, y1), max_x = std::max(x0, x1), max_y = std::max(y0, y1);
+  bool found = false;
+  int cx0, cy0, cx1, cy1;
+  grid_range(shape, min_x, min_y, max_x, max_y, &cx0, &cy0, &cx1, &cy1);
+  for (int cy = cy0; cy <= cy1; cy++) {
+    for (int cx = cx0; cx <= cx1; cx++) {
+      int c = cy * shape.nx + cx;
+      for (int k = g.start[c], last = g.start[c] + g.count[c]; k < last; k++) {
+        const Polygon& o = obstacles[g.items[k]];
+        // Cells are coarse, most polygons in them are far from the ball.
+        // One branch for the four tests, it is rarely false.
+        bool apart = (max_x < o.box.min_x - BALL_RADIUS) | (min_x > o.box.max_x + BALL_RADIUS) |
+                     (max_y < o.box.min_y - BALL_RADIUS) | (min_y > o.box.max_y + BALL_RADIUS);
+        if (apart)
+          continue;
+        float toi, n_x, n_y;
+        if (sweep_circle_polygon(x0, y0, dx, dy, o, BALL_RADIUS, &toi, &n_x, &n_y) && (!found || toi < *t)) {
+          *t = toi;
+          *nx = n_x;
+          *ny = n_y;
+          found = true;
+        }
+      }
+    }
+  }
+  return found;
+}
+
+/* Pushes a ball out of every obstacle it still overlaps and drops its
+   speed into them, never past the walls */
+static void separateObstacles (Projectiles& p, const IntegrateParams& w, int i)
+{
+  const UniformGrid& g = obstacle_grid;
+  int cx0, cy0, cx1, cy1;
+  grid_range(g.shape, p.x[i], p.y[i], p.x[i], p.y[i], &cx0, &cy0, &cx1, &cy1);
+  int c = cy0 * g.shape.nx + cx0;
+  for (int k = g.start[c], last = g.start[c] + g.count[c]; k < last; k++) {
+    float nx, ny, depth;
+    if (!circle_polygon_overlap(obstacles[g.items[k]], p.x[i], p.y[i], BALL_RADIUS, &nx, &ny, &depth))
+      continue;
+    p.x[i] = std::min(std::max(p.x[i] + nx * (depth + CONTACT_SLOP), w.left), w.right);
+    p.y[i] = std::min(std::max(p.y[i] + ny * (depth + CONTACT_SLOP), w.bottom), w.top);
+    float vn = p.vx[i] * nx + p.vy[i] * ny;
+    if (vn < 0) {
+      p.vx[i] -= vn * nx;
+      p.vy[i] -= vn * ny;
+    }
+  }
+}
+
+/* Ends a leg from (x0, y0) that leaves the walls where it crosses them
+   and mirrors the rest back in as integrate() does, into a second leg
+   ending at (ex, ey). Returns the walls crossed; 'flipped' gets the ones
+   the speed was turned around at. */
+static int cutAtWalls (Projectiles& p, const IntegrateParams& k, int i, float x0, float y0, float* x1, float* y1, float* ex, float* ey, int* flipped)
+{
+  int walls = 0;
+  float cut = 1;
+  *ex = *x1;
+  *ey = *y1;
+  *flipped = 0;
+  if (*x1 < k.left || *x1 > k.right) {
+    float wall = *x1 < k.left ? k.left : k.right;
+    cut = (wall - x0) / (*x1 - x0);
+    *ex = std::min(std::max(wall + (*x1 - wall) * k.bounce, k.left), k.right);
+    if ((p.vx[i] < 0) == (wall == k.left)) {
+      p.vx[i] *= k.bounce;
+      *flipped |= 1;
+    }
+    walls |= 1;
+  }
+  if (*y1 < k.bottom || *y1 > k.top) {
+    float wall = *y1 < k.bottom ? k.bottom : k.top;
+    cut = std::min(cut, (wall - y0) / (*y1 - y0));
+    *ey = std::min(std::max(wall + (*y1 - wall) * k.bounce, k.bottom), k.top);
+    if ((p.vy[i] < 0) == (wall == k.bottom)) {
+      p.vy[i] *= k.bounce;
+      *flipped |= 2;
+    }
+    walls |= 2;
+  }
+  if (walls) {
+    cut = std::min(std::max(cut, 0.0f), 1.0f);
+    *x1 = x0 + cut * (*x1 - x0);
+    *y1 = y0 + cut * (*y1 - y0);
+  }
+  return walls;
+}
+
+/* Moves one chunk of balls and lists the targets they touch in the
+   chunk's own list, so chunks never write to the same place */
+static void stepBalls (void* data, int begin, int end)
+{
+  StepJob* job = (StepJob*) data;
+  SimState& s = *job->s;
+  Projectiles& p = s.balls;
+  const IntegrateParams& k = job->k;
+  integrate(p, k, begin, end);
+
+  std::vector<int>& hits = s.chunk_hits[begin / BALLS_PER_JOB];
+  hits.clear();
+  bool any_targets = s.grid.live > 0, any_obstacles = obstacle_grid.live > 0;
+  if (!any_targets && !any_obstacles)
+    return;
+  for (int i = begin; i < end; i++) {
+    // A ball that rebounded went from its start to the wall and on to its
+    // mirrored end. The first leg lies on the segment to the end it would
+    // have had without the wall and stops where that crosses the wall, the
+    // second runs from there straight to the mirrored end.
+    float x0 = p.px[i], y0 = p.py[i], x1 = p.x[i], y1 = p.y[i];
+    int walls = p.bounced[i];
+    if (walls) {
+      float ux = x1, uy = y1, cut = 1;
+      if (walls & 1) {
+        float wall = p.vx[i] > 0 ? k.left : k.right;
+        ux = wall + (x1 - wall) / k.bounce;
+        cut = (wall - x0) / (ux - x0);
+      }
+      if (walls & 2) {
+        float wall = p.vy[i] > 0 ? k.bottom : k.top;
+        uy = wall + (y1 - wall) / k.bounce;
+        cut = std::min(cut, (wall - y0) / (uy - y0));
+      }
+      cut = std::min(std::max(cut, 0.0f), 1.0f);
+      x1 = x0 + cut * (ux - x0);
+      y1 = y0 + cut * (uy - y0);
+    }
+    if (!any_obstacles) {
+      sweepTargets(s, x0, y0, x1, y1, hits);
+      if (walls)
+        sweepTargets(s, x1, y1, p.x[i], p.y[i], hits);
+      continue;
+    }
+
+    // Legs are cut at every obstacle contact, the rest of the leg is
+    // reflected off it. A ball stopped before the wall never reaches it,
+    // one sent out of the walls gets a second leg of its own.
+    bool second_leg = walls != 0;
+    float ex = p.x[i], ey = p.y[i];   // end of the second leg
+    int flipped = walls;              // speeds turned around by a wall
+    int contacts = 0;
+    for (;;) {
+      float toi, nx, ny;
+      if (contacts < MAX_CONTACTS && sweepObstacles(x0, y0, x1, y1, &toi, &nx, &ny)) {
+        float cx = x0 + toi * (x1 - x0), cy = y0 + toi * (y1 - y0);
+        if (any_targets)
+          sweepTargets(s, x0, y0, cx, cy, hits);
+        float rx = x1 - cx, ry = y1 - cy;
+        if (second_leg) {
+          // Stopped before the wall: the rest of the way as if it was not there
+          rx += (ex - x1) / (walls & 1 ? k.bounce : 1);
+          ry += (ey - y1) / (walls & 2 ? k.bounce : 1);
+          if (flipped & 1)
+            p.vx[i] /= k.bounce;
+          if (flipped & 2)
+            p.vy[i] /= k.bounce;
+          second_leg = false;
+        }
+        float vn = p.vx[i] * nx + p.vy[i] * ny;
+        if (vn < 0) {
+          p.vx[i] -= (1 + restitution) * vn * nx;
+          p.vy[i] -= (1 + restitution) * vn * ny;
+        }
+        float rn = rx * nx + ry * ny;
+        if (rn < 0) {
+          rx -= (1 + restitution) * rn * nx;
+          ry -= (1 + restitution) * rn * ny;
+        }
+        // Wedged in a gap: it stays where it is for the rest of the step
+        if (++contacts == MAX_CONTACTS)
+          rx = ry = 0;
+        x0 = cx + nx * CONTACT_SLOP;
+        y0 = cy + ny * CONTACT_SLOP;
+        x1 = x0 + rx;
+        y1 = y0 + ry;
+        walls = cutAtWalls(p, k, i, x0, y0, &x1, &y1, &ex, &ey, &flipped);
+        second_leg = walls != 0;
+        continue;
+      }
+      if (any_targets)
+        sweepTargets(s, x0, y0, x1, y1, hits);
+      if (!second_leg)
+        break;
+      x0 = x1;
+      y0 = y1;
+      x1 = ex;
+      y1 = ey;
+      second_leg = false;
+    }
+    if (contacts) {
+      p.x[i] = x1;
+      p.y[i] = y1;
+      separateObstacles(p, k, i);
+    }
+  }
+}
+
+/* One shot: c.spread balls fanned out around the cannon direction */
+static void fireShot (SimState& s, const Controls& c)
+{
+  float x, y;
+  sim_muzzle(s.cannon_rotation, &x, &y);
+  int n = c.spread > 1 ? c.spread : 1;
+  for (int k = 0; k < n; k++) {
+    float angle = (s.cannon_rotation + (k - (n - 1) * 0.5f) * SPREAD_ANGLE) * M_PI / 180.0f;
+    projectiles_spawn(s.balls, x, y, -c.speed * std::sin(angle), c.speed * std::cos(angle), BALL_LIFETIME);
+  }
+}
+
+void sim_step (SimState& s, const Controls& c, float dt)
+{
+  s.tick++;
+
+  s.prev_rotation = s.cannon_rotation;
+  if (c.rotating) {
+    s.cannon_rotation += CANNON_TURN_RATE * c.rotate_dir * dt;
+    // Past either side the cannon comes back in from the other one
+    if (s.cannon_rotation > 90)
+      s.cannon_rotation = -90;
+    else if (s.cannon_rotation < -90)
+      s.cannon_rotation = 90;
+  }
+
+  IntegrateParams k = { dt, 0.5f * gravity * dt * dt, gravity * dt, -(1 - damping),
+                        wall_left, wall_right, wall_bottom, wall_top };
+  StepJob job = { &s, k };
+  int count = s.balls.count;
+  int chunks = (count + BALLS_PER_JOB - 1) / BALLS_PER_JOB;
+  if ((int)s.chunk_hits.size() < std::max(chunks, 1))
+    s.chunk_hits.resize(std::max(chunks, 1));
+  if (chunks <= 1)
+    stepBalls(&job, 0, count);
+  else {
+    JobCounter done;
+    jobs_parallel_for(stepBalls, &job, count, BALLS_PER_JOB, &done);
+    jobs_wait(&done);
+  }
+
+  // Merged in chunk order, the result does not depend on the threads
+  for (int c = 0; c < std::max(chunks, 1); c++) {
+    const std::vector<int>& hits = s.chunk_hits[c];
+    for (size_t h = 0; h < hits.size(); h++) {
+      int t = hits[h];
+      if (s.hit[t])
+        continue;
+      s.hit[t] = 1;
+      s.score++;
+      grid_remove(s.grid, target_box(targets[t]), t);
+    }
+  }
+  projectiles_compact(s.balls);
+
+  // New balls start at the muzzle and move from the next step on
+  if (c.fire && s.burst_left == 0) {
+    s.burst_left = c.burst > 1 ? c.burst : 1;
+    s.burst_wait = 0;
+  }
+  if (s.burst_left > 0) {
+    s.burst_wait -= dt;
+    if (s.burst_wait <= 0) {
+      fireShot(s, c);
+      s.burst_left--;
+      s.burst_wait += BURST_INTERVAL;
+    }
+  }
+}
+
+bool sim_set_rate (double hz)
+{
+  if (!(hz > 0) || std::isinf(hz))
+    return false;
+  step_rate = hz;
+  return true;
+}
+
+double sim_rate ()
+{
+  return step_rate;
+}
+
+// First step the controls are read by next, known while steps run
+static unsigned long input_tick = 0;
+static InputDrain input_drain = NULL;
+
+void sim_set_input (InputDrain drain)
+{
+  input_drain = drain;
+}
+
+void sim_tick ()
+{
+  ProfileScope profile(PROFILE_PHYSICS);
+  if (input_drain)
+    input_drain(sim.tick, INFINITY);
+  sim_step(sim, controls, 1.0 / step_rate);
+  controls.fire = false;
+  input_tick = sim.tick;
+}
+
+unsigned long sim_input_tick ()
+{
+  return input_tick;
+}
+
+static int step_count = 0;
+static double first_step_end;   // on the clock of sim_launch()
+static JobCounter steps_done;
+
+static void runSteps (void*, int, int)
+{
+  ProfileScope profile(PROFILE_PHYSICS);
+  double dt = 1.0 / step_rate;
+  for (int i = 0; i < step_count; i++) {
+    if (input_drain)
+      input_drain(sim.tick, first_step_end + i * dt);
+    sim_step(sim, controls, dt);
+    controls.fire = false;
+  }
+}
+
+double sim_launch (double now)
+{
+  sim_wait();
+  double dt = 1.0 / step_rate;
+  if (last_time < 0)
+    last_time = now;
+  accumulator += now - last_time;
+  last_time = now;
+
+  int steps = 0;
+  while (accumulator >= dt && steps < MAX_STEPS_PER_FRAME) {
+    accumulator -= dt;
+    steps++;
+  }
+  if (steps == MAX_STEPS_PER_FRAME && accumulator >= dt)
+    accumulator = 0;
+
+  if (steps) {
+    step_count = steps;
+    first_step_end = now - accumulator - (steps - 1) * dt;
+    input_tick = sim.tick + steps;
+    jobs_run(runSteps, NULL, &steps_done);
+  }
+  return accumulator / dt;
+}
+
+void sim_wait ()
+{
+  jobs_wait(&steps_done);
+}
+
+void sim_snapshot (SimView& v)
+{
+  v.tick = sim.tick;
+  v.cannon_rotation = sim.cannon_rotation;
+  v.prev_rotation = sim.prev_rotation;
+  v.hit = sim.hit;
+  v.score = sim.score;
+
+  const Projectiles& p = sim.balls;
+  v.count = p.count;
+  v.x.assign(p.x.begin(), p.x.begin() + p.count);
+  v.y.assign(p.y.begin(), p.y.begin() + p.count);
+  v.px.assign(p.px.begin(), p.px.begin() + p.count);
+  v.py.assign(p.py.begin(), p.py.begin() + p.count);
+}
@@ -0,0 +1,108 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+/* Game physics, stepped at a fixed rate independent of the frame rate.
+   Positions are in level coordinates, the space draw() reaches through
+   translateAxes: (0,0) is the bottom left corner, the walls are at 0 and 8. */
+
+#include <vector>
+
+#include "projectiles.h"
+#include "broadphase.h"
+
+#define BALL_RADIUS 0.1f
+#define MAX_PROJECTILES 4096
+// Seconds a ball stays in play
+#define BALL_LIFETIME 10.0f
+
+static const float gravity = -4.0f;
+// Share of the speed a ball loses on a wall
+static const float damping = 0.05f;
+static const float wall_left = 0.0f, wall_right = 8.0f, wall_bottom = 0.0f, wall_top = 8.0f;
+
+/* Targets of the level, the same for every SimState */
+extern std::vector<Target> targets;
+/* Replaces the targets, states have to be reset afterwards */
+void sim_set_targets (const std::vector<Target>& list);
+
+/* Static obstacles the balls bounce off */
+extern std::vector<Polygon> obstacles;
+void sim_set_obstacles (const std::vector<Polygon>& list);
+
+/* Broad phase of the ball tests against targets and obstacles: a uniform
+   grid (the default), or a BVH whose queries stay logarithmic whatever the
+   size and layout of the level */
+enum { BROADPHASE_GRID, BROADPHASE_BVH };
+/* "grid" or "bvh", false for anything else */
+bool sim_set_broadphase (const char* name);
+const char* sim_broadphase_name ();
+
+/* Set by the input drain right before each step, read once per step */
+struct Controls {
+  bool rotating;
+  float rotate_dir;
+  float speed;      // launch speed in units per second
+  int spread;       // balls per shot, fanned out around the cannon direction
+  int burst;        // shots per trigger, a few steps apart
+  bool fire;
+};
+extern Controls controls;
+
+/* Everything one step changes. Moving parts keep their value from the
+   previous step too, draw() interpolates between the two. */
+struct SimState {
+  unsigned long tick;
+  float cannon_rotation;   // degrees, 0 points straight up
+  float prev_rotation;
+  int burst_left;          // shots of the current burst still to fire
+  float burst_wait;        // seconds to the next one
+  Projectiles balls;
+  std::vector<unsigned char> hit;   // per target
+  int score;
+  UniformGrid grid;                 // targets not hit yet
+  std::vector< std::vector<int> > chunk_hits;   // targets touched, per chunk of the parallel step
+};
+
+extern SimState sim;
+
+void sim_reset (SimState& s, int capacity=MAX_PROJECTILES);
+void sim_step (SimState& s, const Controls& c, float dt);
+
+/* Muzzle position of the cannon in level coordinates */
+void sim_muzzle (float cannon_rotation, float* x, float* y);
+
+/* Fixed timestep driver. False unless 'hz' is positive and finite. */
+bool sim_set_rate (double hz);
+double sim_rate ();
+/* Starts every step due by 'now' (seconds) on the job system and returns
+   how far 'now' will be between the previous and the current step, in
+   [0, 1]. The steps run while the caller draws; sim_wait() before touching
+   'sim'. */
+double sim_launch (double now);
+void sim_wait ();
+/* Exactly one step, on the calling thread and its helpers, for
+   deterministic headless runs */
+void sim_tick ();
+/* Tick of the next step to read 'controls', what input arriving now
+   applies to. Safe while steps run. */
+unsigned long sim_input_tick ();
+/* Called right before every step, on the thread running it, with the
+   tick of the step and the time it ends at on the clock of sim_launch():
+   input due by then goes into 'controls'. sim_tick() passes INFINITY. */
+typedef void (*InputDrain) (unsigned long tick, double until);
+void sim_set_input (InputDrain drain);
+
+/* What draw() needs of the state, copied so it can be drawn while the
+   next steps run */
+struct SimView {
+  unsigned long tick;
+  float cannon_rotation, prev_rotation;
+  std::vector<unsigned char> hit;
+  int score;
+  int count;
+  std::vector<float> x, y, px, py;
+};
+/* Only while no steps are running */
+void sim_snapshot (SimView& v);
+
+#endif
@@ -0,0 +1,425 @@
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "soft_raster.h"
+#include "trace.h"
+
+#define TILE_SIZE 64
+
+/* A clip space vertex, as it leaves the vertex shader */
+struct SrClipVertex {
+  float x, y, z, w;
+  float r, g, b;
+};
+
+/* Edge functions and attribute planes of one screen space triangle.
+   Every plane is evaluated at pixel centres as dx*x + dy*y + c */
+struct SrTriangle {
+  float ea[3], eb[3], ec[3];
+  bool top_left[3];
+  float z[3], invw[3], r[3], g[3], b[3];
+  int minx, miny, maxx, maxy;
+};
+
+static int fb_width = 0, fb_height = 0, fb_stride = 0;
+static int tiles_x = 0, tiles_y = 0;
+static std::vector<unsigned int> color_buffer;
+static std::vector<float> depth_buffer;
+
+static unsigned int clear_rgba = 0xff000000;
+static bool clear_pending = false;
+
+static std::vector<SrTriangle> triangles;
+static std::vector< std::vector<int> > bins;
+
+// Worker pool, woken up once per sr_finish
+static std::vector<std::thread> workers;
+static std::mutex pool_mutex;
+static std::condition_variable pool_wake, pool_done;
+static unsigned long pool_generation = 0;
+static int pool_busy = 0;
+static bool pool_exit = false;
+static std::atomic<int> next_tile(0);
+
+static unsigned int pack_color (float r, float g, float b, float a)
+{
+  unsigned int R = (unsigned int)(std::min(std::max(r, 0.0f), 1.0f) * 255.0f + 0.5f);
+  unsigned int G = (unsigned int)(std::min(std::max(g, 0.0f), 1.0f) * 255.0f + 0.5f);
+  unsigned int B = (unsigned int)(std::min(std::max(b, 0.0f), 1.0f) * 255.0f + 0.5f);
+  unsigned int A = (unsigned int)(std::min(std::max(a, 0.0f), 1.0f) * 255.0f + 0.5f);
+  return R | (G << 8) | (B << 16) | (A << 24);
+}
+
+/* Plane through the three vertex values of an attribute, using the edge functions */
+static void attribute_plane (const SrTriangle& t, float area, float a0, float a1, float a2, float* plane)
+{
+  plane[0] = (t.ea[0]*a0 + t.ea[1]*a1 + t.ea[2]*a2) / area;
+  plane[1] = (t.eb[0]*a0 + t.eb[1]*a1 + t.eb[2]*a2) / area;
+  plane[2] = (t.ec[0]*a0 + t.ec[1]*a1 + t.ec[2]*a2) / area;
+}
+
+/* Project a clipped triangle, compute its planes and bin it into the tiles it touches */
+static void setup_triangle (const SrClipVertex& c0, const SrClipVertex& c1, const SrClipVertex& c2)
+{
+  const SrClipVertex* cv[3] = { &c0, &c1, &c2 };
+  float sx[3], sy[3], sz[3], iw[3];
+  for (int i = 0; i < 3; i++) {
+    iw[i] = 1.0f / cv[i]->w;
+    // NDC to window coordinates, y flipped so that row 0 is the top row
+    sx[i] = (cv[i]->x * iw[i] * 0.5f + 0.5f) * fb_width;
+    sy[i] = (0.5f - cv[i]->y * iw[i] * 0.5f) * fb_height;
+    sz[i] = cv[i]->z * iw[i] * 0.5f + 0.5f;
+  }
+
+  float area = (sx[1]-sx[0])*(sy[2]-sy[0]) - (sy[1]-sy[0])*(sx[2]-sx[0]);
+  if (area == 0 || area != area)
+    return;
+  // No culling in the sample, so just flip clockwise triangles around
+  int order[3] = { 0, 1, 2 };
+  if (area < 0) {
+    order[1] = 2;
+    order[2] = 1;
+    area = -area;
+  }
+
+  SrTriangle t;
+  float minx = fb_width, miny = fb_height, maxx = 0, maxy = 0;
+  for (int e = 0; e < 3; e++) {
+    // Edge e is the one opposite to vertex e
+    int a = order[(e+1)%3], b = order[(e+2)%3];
+    t.ea[e] = -(sy[b] - sy[a]);
+    t.eb[e] = sx[b] - sx[a];
+    t.ec[e] = -(t.ea[e]*sx[a] + t.eb[e]*sy[a]);
+    t.top_left[e] = t.ea[e] > 0 || (t.ea[e] == 0 && t.eb[e] > 0);
+    minx = std::min(minx, sx[e]);
+    maxx = std::max(maxx, sx[e]);
+    miny = std::min(miny, sy[e]);
+    maxy = std::max(maxy, sy[e]);
+  }
+
+  // Pixels whose centre can be covered
+  t.minx = std::max(0, (int)std::floor(minx - 0.5f));
+  t.miny = std::max(0, (int)std::floor(miny - 0.5f));
+  t.maxx = std::min(fb_width - 1, (int)std::ceil(maxx - 0.5f));
+  t.maxy = std::min(fb_height - 1, (int)std::ceil(maxy - 0.5f));
+  if (t.minx > t.maxx || t.miny > t.maxy)
+    return;
+
+  const SrClipVertex* v0 = cv[order[0]];
+  const SrClipVertex* v1 = cv[order[1]];
+  const SrClipVertex* v2 = cv[order[2]];
+  float w0 = iw[order[0]], w1 = iw[order[1]], w2 = iw[order[2]];
+  attribute_plane(t, area, sz[order[0]], sz[order[1]], sz[order[2]], t.z);
+  // Colors are divided by w so the interpolation is perspective correct
+  attribute_plane(t, area, w0, w1, w2, t.invw);
+  attribute_plane(t, area, v0->r*w0, v1->r*w1, v2->r*w2, t.r);
+  attribute_plane(t, area, v0->g*w0, v1->g*w1, v2->g*w2, t.g);
+  attribute_plane(t, area, v0->b*w0, v1->b*w1, v2->b*w2, t.b);
+
+  int index = (int)triangles.size();
+  triangles.push_back(t);
+  for (int ty = t.miny / TILE_SIZE; ty <= t.maxy / TILE_SIZE; ty++)
+    for (int tx = t.minx / TILE_SIZE; tx <= t.maxx / TILE_SIZE; tx++)
+      bins[ty*tiles_x + tx].push_back(index);
+}
+
+static SrClipVertex clip_lerp (const SrClipVertex& a, const SrClipVertex& b, float t)
+{
+  SrClipVertex v;
+  v.x = a.x + (b.x - a.x) * t;
+  v.y = a.y + (b.y - a.y) * t;
+  v.z = a.z + (b.z - a.z) * t;
+  v.w = a.w + (b.w - a.w) * t;
+  v.r = a.r + (b.r - a.r) * t;
+  v.g = a.g + (b.g - a.g) * t;
+  v.b = a.b + (b.b - a.b) * t;
+  return v;
+}
+
+/* Clip against the near and far planes, x and y are handled by the scissor of the bounding box */
+static void clip_triangle (const SrClipVertex& a, const SrClipVertex& b, const SrClipVertex& c)
+{
+  bool inside = true;
+  const SrClipVertex* in[3] = { &a, &b, &c };
+  for (int i = 0; i < 3; i++)
+    if (in[i]->z < -in[i]->w || in[i]->z > in[i]->w)
+      inside = false;
+  if (inside) {
+    setup_triangle(a, b, c);
+    return;
+  }
+
+  SrClipVertex poly[2][9];
+  int count = 3;
+  poly[0][0] = a; poly[0][1] = b; poly[0][2] = c;
+  int src = 0;
+  for (int plane = 0; plane < 2; plane++) {
+    int dst = 1 - src, out = 0;
+    float sign = plane == 0 ? 1.0f : -1.0f;
+    for (int i = 0; i < count; i++) {
+      const SrClipVertex& p = poly[src][i];
+      const SrClipVertex& q = poly[src][(i+1)%count];
+      float dp = p.w + sign * p.z, dq = q.w + sign * q.z;
+      if (dp >= 0)
+        poly[dst][out++] = p;
+      if ((dp >= 0) != (dq >= 0))
+        poly[dst][out++] = clip_lerp(p, q, dp / (dp - dq));
+    }
+    count = out;
+    src = dst;
+  }
+  for (int i = 1; i + 1 < count; i++)
+    setup_triangle(poly[src][0], poly[src][i], poly[src][i+1]);
+}
+
+/* Rasterize every binned triangle overlapping one tile, in submission order */
+static void raster_tile (int tile)
+{
+  int x0 = (tile % tiles_x) * TILE_SIZE, y0 = (tile / tiles_x) * TILE_SIZE;
+  int x1 = std::min(x0 + TILE_SIZE, fb_width), y1 = std::min(y0 + TILE_SIZE, fb_height);
+
+  if (clear_pending) {
+    for (int y = y0; y < y1; y++) {
+      std::fill(&color_buffer[y*fb_stride + x0], &color_buffer[y*fb_stride + x1], clear_rgba);
+      std::fill(&depth_buffer[y*fb_stride + x0], &depth_buffer[y*fb_stride + x1], 1.0f);
+    }
+  }
+
+  const std::vector<int>& bin = bins[tile];
+  for (size_t n = 0; n < bin.size(); n++) {
+    const SrTriangle& t = triangles[bin[n]];
+    int bx0 = std::max(t.minx, x0) & ~3, bx1 = std::min(t.maxx + 1, x1);
+    int by0 = std::max(t.miny, y0), by1 = std::min(t.maxy + 1, y1);
+
+    for (int y = by0; y < by1; y++) {
+      float py = y + 0.5f;
+      unsigned int* crow = &color_buffer[y*fb_stride];
+      float* zrow = &depth_buffer[y*fb_stride];
+#if defined(__SSE2__)
+      // Four pixels per iteration, rows are padded to a multiple of four
+      const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 scale = _mm_set1_ps(255.0f);
+      __m128 ea[3], erow[3], tl[3];
+      for (int e = 0; e < 3; e++) {
+        ea[e] = _mm_set1_ps(t.ea[e]);
+        erow[e] = _mm_set1_ps(t.eb[e]*py + t.ec[e]);
+        tl[e] = _mm_castsi128_ps(_mm_set1_epi32(t.top_left[e] ? -1 : 0));
+      }
+      for (int x = bx0; x < bx1; x += 4) {
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+        __m128 mask = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(x), _mm_set_epi32(3, 2, 1, 0)), _mm_set1_epi32(x1)));
+        for (int e = 0; e < 3; e++) {
+          __m128 w = _mm_add_ps(_mm_mul_ps(ea[e], px), erow[e]);
+          __m128 in = _mm_or_ps(_mm_cmpgt_ps(w, zero), _mm_and_ps(_mm_cmpeq_ps(w, zero), tl[e]));
+          mask = _mm_and_ps(mask, in);
+        }
+        if (_mm_movemask_ps(mask) == 0)
+          continue;
+
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.z[0]), px), _mm_set1_ps(t.z[1]*py + t.z[2]));
+        __m128 zold = _mm_loadu_ps(&zrow[x]);
+        mask = _mm_and_ps(mask, _mm_cmple_ps(z, zold));
+        if (_mm_movemask_ps(mask) == 0)
+          continue;
+
+        __m128 invw = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.invw[0]), px), _mm_set1_ps(t.invw[1]*py + t.invw[2]));
+        __m128 wscale = _mm_div_ps(scale, invw);
+        __m128 r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.r[0]), px), _mm_set1_ps(t.r[1]*py + t.r[2])), wscale);
+        __m128 g = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.g[0]), px), _mm_set1_ps(t.g[1]*py + t.g[2])), wscale);
+        __m128 b = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.b[0]), px), _mm_set1_ps(t.b[1]*py + t.b[2])), wscale);
+        __m128 half = _mm_set1_ps(0.5f);
+        __m128i R = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(r, zero), scale), half));
+        __m128i G = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(g, zero), scale), half));
+        __m128i B = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(b, zero), scale), half));
+        __m128i rgba = _mm_or_si128(_mm_or_si128(R, _mm_slli_epi32(G, 8)), _mm_or_si128(_mm_slli_epi32(B, 16), _mm_set1_epi32((int)0xff000000)));
+
+        __m128i imask = _mm_castps_si128(mask);
+        __m128i cold = _mm_loadu_si128((__m128i*)&crow[x]);
+        _mm_storeu_si128((__m128i*)&crow[x], _mm_or_si128(_mm_and_si128(imask, rgba), _mm_andnot_si128(imask, cold)));
+        _mm_storeu_ps(&zrow[x], _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, zold)));
+      }
+#else
+      for (int x = bx0; x < bx1; x++) {
+        float px = x + 0.5f;
+        bool in = x >= t.minx;
+        for (int e = 0; e < 3 && in; e++) {
+          float w = t.ea[e]*px + t.eb[e]*py + t.ec[e];
+          in = w > 0 || (w == 0 && t.top_left[e]);
+        }
+        if (!in)
+          continue;
+        float z = t.z[0]*px + t.z[1]*py + t.z[2];
+        if (z > zrow[x])
+          continue;
+        float w = 1.0f / (t.invw[0]*px + t.invw[1]*py + t.invw[2]);
+        zrow[x] = z;
+        crow[x] = pack_color((t.r[0]*px + t.r[1]*py + t.r[2]) * w,
+                             (t.g[0]*px + t.g[1]*py + t.g[2]) * w,
+                             (t.b[0]*px + t.b[1]*py + t.b[2]) * w, 1.0f);
+      }
+#endif
+    }
+  }
+}
+
+static void raster_tiles ()
+{
+  TraceScope trace("raster tiles");
+  int count = tiles_x * tiles_y;
+  for (int tile = next_tile++; tile < count; tile = next_tile++)
+    raster_tile(tile);
+}
+
+static void worker_main ()
+{
+  trace_thread_name("raster");
+  unsigned long seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(pool_mutex);
+      pool_wake.wait(lock, [&] { return pool_exit || pool_generation != seen; });
+      if (pool_exit)
+        return;
+      seen = pool_generation;
+    }
+    raster_tiles();
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      if (--pool_busy == 0)
+        pool_done.notify_one();
+    }
+  }
+}
+
+void sr_init (int width, int height, int threads)
+{
+  if (threads <= 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  sr_viewport(width, height);
+  // The calling thread rasterizes too
+  for (int i = 1; i < threads; i++)
+    workers.push_back(std::thread(worker_main));
+}
+
+void sr_shutdown ()
+{
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pool_exit = true;
+  }
+  pool_wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+  workers.clear();
+}
+
+void sr_viewport (int width, int height)
+{
+  if (width == fb_width && height == fb_height)
+    return;
+  sr_finish();
+  fb_width = width;
+  fb_height = height;
+  fb_stride = (width + 3) & ~3;
+  tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+  tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+  color_buffer.assign((size_t)fb_stride * height, clear_rgba);
+  depth_buffer.assign((size_t)fb_stride * height, 1.0f);
+  bins.assign(tiles_x * tiles_y, std::vector<int>());
+}
+
+void sr_clear_color (float r, float g, float b, float a)
+{
+  clear_rgba = pack_color(r, g, b, a);
+}
+
+void sr_clear ()
+{
+  // A clear after some draws has to land after them
+  if (!triangles.empty())
+    sr_finish();
+  clear_pending = true;
+}
+
+void sr_draw (const float* mvp, unsigned int mode, const float* vertices, const float* colors, int count)
+{
+  if (count < 3 || (mode != SR_TRIANGLES && mode != SR_TRIANGLE_FAN))
+    return;
+
+  // Vertex shader: gl_Position = MVP * vec4(vertexPosition, 1)
+  std::vector<SrClipVertex> clip(count);
+  for (int i = 0; i < count; i++) {
+    const float* p = &vertices[3*i];
+    SrClipVertex& v = clip[i];
+    v.x = mvp[0]*p[0] + mvp[4]*p[1] + mvp[8]*p[2] + mvp[12];
+    v.y = mvp[1]*p[0] + mvp[5]*p[1] + mvp[9]*p[2] + mvp[13];
+    v.z = mvp[2]*p[0] + mvp[6]*p[1] + mvp[10]*p[2] + mvp[14];
+    v.w = mvp[3]*p[0] + mvp[7]*p[1] + mvp[11]*p[2] + mvp[15];
+    v.r = colors[3*i];
+    v.g = colors[3*i + 1];
+    v.b = colors[3*i + 2];
+  }
+
+  if (mode == SR_TRIANGLES) {
+    for (int i = 0; i + 2 < count; i += 3)
+      clip_triangle(clip[i], clip[i+1], clip[i+2]);
+  }
+  else {
+    for (int i = 1; i + 1 < count; i++)
+      clip_triangle(clip[0], clip[i], clip[i+1]);
+  }
+}
+
+void sr_finish ()
+{
+  if (triangles.empty() && !clear_pending)
+    return;
+
+  next_tile = 0;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pool_busy = (int)workers.size();
+    pool_generation++;
+  }
+  pool_wake.notify_all();
+  raster_tiles();
+  {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    pool_done.wait(lock, [] { return pool_busy == 0; });
+  }
+
+  triangles.clear();
+  for (size_t i = 0; i < bins.size(); i++)
+    bins[i].clear();
+  clear_pending = false;
+}
+
+int sr_width ()
+{
+  return fb_width;
+}
+
+int sr_height ()
+{
+  return fb_height;
+}
+
+int sr_stride ()
+{
+  return fb_stride;
+}
+
+const unsigned int* sr_pixels ()
+{
+  return color_buffer.empty() ? NULL : &color_buffer[0];
+}
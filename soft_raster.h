@@ -0,0 +1,31 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+/* Pure CPU rasterizer used as the software backend of draw3DObject.
+   It mirrors Sample_GL.vert/.frag: positions are transformed by the MVP,
+   colors are interpolated across the triangle, depth test is GL_LEQUAL.
+   Draws are only set up and binned into tiles, sr_finish rasterizes the
+   tiles on all cores. No GL headers are needed here. */
+
+// Same values as the GL enums so a VAO's PrimitiveMode can be passed as is
+#define SR_TRIANGLES      0x0004
+#define SR_TRIANGLE_FAN   0x0006
+
+void sr_init (int width, int height, int threads=0);
+void sr_shutdown ();
+
+void sr_viewport (int width, int height);
+void sr_clear_color (float r, float g, float b, float a);
+void sr_clear ();
+
+/* mvp is column major like glUniformMatrix4fv, vertices/colors are xyz/rgb triples */
+void sr_draw (const float* mvp, unsigned int mode, const float* vertices, const float* colors, int count);
+void sr_finish ();
+
+int sr_width ();
+int sr_height ();
+int sr_stride ();
+/* RGBA8 pixels (r in the low byte), top row first, sr_stride() pixels per row */
+const unsigned int* sr_pixels ();
+
+#endif
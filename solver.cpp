@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+
+#include "solver.h"
+#include "simulation.h"
+#include "ccd.h"
+
+/* Unit direction of the cannon */
+static void aim (float angle, float* ux, float* uy)
+{
+  float a = angle * M_PI / 180.0f;
+  *ux = -std::sin(a);
+  *uy = std::cos(a);
+}
+
+/* Horizontal position at 'time' of a ball starting at x0 with speed vx,
+   rebounding off the side walls */
+static float travel (float x0, float vx, float time)
+{
+  float bounce = 1 - damping;
+  for (;;) {
+    float wall = vx < 0 ? wall_left : wall_right;
+    float to_wall = (wall - x0) / vx;
+    if (to_wall >= time)
+      return x0 + vx * time;
+    time -= to_wall;
+    x0 = wall;
+    vx = -vx * bounce;
+  }
+}
+
+/* Walks the path in the steps the simulation takes and sweeps every
+   obstacle with each of them, up to where the ball touches the target */
+static bool blocked (const ShotSolution& s)
+{
+  const Target& target = targets[s.target];
+  float x0, y0, ux, uy;
+  sim_muzzle(s.angle, &x0, &y0);
+  aim(s.angle, &ux, &uy);
+  float vx = s.speed * ux, vy = s.speed * uy;
+  float dt = 1.0 / sim_rate();
+  float px = x0, py = y0;
+  for (float time = dt; ; time += dt) {
+    if (time > s.time)
+      time = s.time;
+    float x = travel(x0, vx, time), y = y0 + vy * time + 0.5f * gravity * time * time;
+    float reach = 1;
+    bool arrived = time >= s.time || sweep_circle_circle(px, py, x - px, y - py, target.x, target.y, target.radius + BALL_RADIUS, &reach);
+    for (size_t o = 0; o < obstacles.size(); o++) {
+      const Polygon& poly = obstacles[o];
+      float t, nx, ny;
+      if (std::min(px, x) > poly.box.max_x + BALL_RADIUS || std::max(px, x) < poly.box.min_x - BALL_RADIUS ||
+          std::min(py, y) > poly.box.max_y + BALL_RADIUS || std::max(py, y) < poly.box.min_y - BALL_RADIUS)
+        continue;
+      if (sweep_circle_polygon(px, py, x - px, y - py, poly, BALL_RADIUS, &t, &nx, &ny) && t < reach)
+        return true;
+    }
+    if (arrived)
+      return false;
+    px = x;
+    py = y;
+  }
+}
+
+int solve_shots (int target, const float* angles, int count, int max_rebounds, std::vector<ShotSolution>& out)
+{
+  const Target& t = targets[target];
+  float bounce = 1 - damping, width = wall_right - wall_left;
+  size_t first = out.size();
+  for (int i = 0; i < count; i++) {
+    float x0, y0, ux, uy;
+    sim_muzzle(angles[i], &x0, &y0);
+    aim(angles[i], &ux, &uy);
+    if (std::fabs(ux) < 1e-6f)
+      continue;
+    float ax = std::fabs(ux);
+    // Distance over the unit horizontal speed: the first leg to the wall
+    // the cannon points at, full widths between the walls after that,
+    // each slower by the damping, and the last leg to the target
+    float wall = ux < 0 ? wall_left : wall_right;
+    float d = 0, scale = 1;
+    for (int k = 0; k <= max_rebounds; k++) {
+      // Leg k runs from x0 (or a wall) towards 'wall'
+      bool towards_right = (ux > 0) == (k % 2 == 0);
+      float from = k == 0 ? x0 : (towards_right ? wall_left : wall_right);
+      float to_target = towards_right ? t.x - from : from - t.x;
+      if (to_target >= 0) {
+        float D = (d + to_target * scale) / ax;
+        // y0 + uy D + gravity D^2 / (2 speed^2) = target y
+        float rise = t.y - y0 - uy * D;
+        if (rise < 0) {
+          ShotSolution s;
+          s.target = target;
+          s.angle = angles[i];
+          s.speed = D * std::sqrt(gravity / (2 * rise));
+          s.time = D / s.speed;
+          s.rebounds = k;
+          // Above the ceiling on the way up
+          float apex = -s.speed * uy / gravity;
+          bool too_high = apex > 0 && apex < s.time && y0 + 0.5f * s.speed * uy * apex > wall_top;
+          if (s.time < BALL_LIFETIME && !too_high) {
+            s.blocked = blocked(s);
+            out.push_back(s);
+          }
+        }
+      }
+      d += (k == 0 ? std::fabs(wall - x0) : width) * scale;
+      scale /= bounce;
+    }
+  }
+  return out.size() - first;
+}
+
+void solve_level (float step, int max_rebounds, std::vector<ShotSolution>& out)
+{
+  std::vector<float> angles;
+  for (float a = -90 + step; a < 90; a += step)
+    angles.push_back(a);
+  for (size_t t = 0; t < targets.size(); t++)
+    solve_shots(t, &angles[0], angles.size(), max_rebounds, out);
+}
@@ -0,0 +1,33 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <vector>
+
+#include "colliders.h"
+
+/* Closed form aiming. Between rebounds a ball follows a parabola and a
+   rebound off a side wall only mirrors and damps its horizontal speed, so
+   for a cannon angle the time to any x after k rebounds is a fixed
+   distance over the speed, and the speed that puts the ball through a
+   point drops out of the height equation. Paths that touch the floor or
+   the ceiling before the target are not solved for. */
+
+struct ShotSolution {
+  int target;
+  float angle;       // degrees, as the cannon rotation
+  float speed;
+  float time;        // seconds from the muzzle to the target center
+  int rebounds;      // off the side walls
+  bool blocked;      // an obstacle is in the way
+};
+
+/* For each angle, the speeds that take a ball through the center of the
+   target with 0 to max_rebounds side wall rebounds, within the lifetime
+   of a ball. Appended to out, returns how many. */
+int solve_shots (int target, const float* angles, int count, int max_rebounds, std::vector<ShotSolution>& out);
+
+/* Solutions over the whole range of the cannon in steps of 'step' degrees,
+   for every target of the level */
+void solve_level (float step, int max_rebounds, std::vector<ShotSolution>& out);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <atomic>
+#include <vector>
+
+/* Bounded queue between exactly one producer and one consumer thread,
+   without locks: each side only writes its own index and reads the other
+   one. The capacity is rounded up to a power of two. */
+template <typename T>
+struct SpscRing {
+  std::vector<T> slots;
+  unsigned int mask;
+  alignas(64) std::atomic<unsigned int> head;   // next slot to read, written by the consumer
+  alignas(64) std::atomic<unsigned int> tail;   // next slot to write, written by the producer
+
+  explicit SpscRing (unsigned int capacity) : head(0), tail(0)
+  {
+    unsigned int size = 1;
+    while (size < capacity)
+      size *= 2;
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  /* False when full */
+  bool push (const T& value)
+  {
+    unsigned int t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) > mask)
+      return false;
+    slots[t & mask] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* False when empty */
+  bool pop (T& value)
+  {
+    unsigned int h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    value = slots[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* The value pop() would return, left in the queue. False when empty. */
+  bool peek (T& value) const
+  {
+    unsigned int h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    value = slots[h & mask];
+    return true;
+  }
+
+  bool empty () const
+  {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "stress.h"
+
+// Targets share a few colors, and so their circle meshes
+static const float palette[][3] = {
+  { 1, 1, 1 }, { 1, .8f, 0 }, { 0, .6f, 1 }, { .2f, 1, .3f }, { 1, .4f, .1f }, { .7f, .3f, 1 }
+};
+#define PALETTE_SIZE (int)(sizeof(palette) / sizeof(palette[0]))
+
+static unsigned int state;
+static float random01 ()
+{
+  state = state * 1664525u + 1013904223u;
+  return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+/* A point at least 'margin' inside the walls and outside the corner of
+   the cannon */
+static void place (float margin, float* x, float* y)
+{
+  do {
+    *x = margin + random01() * (wall_right - 2 * margin);
+    *y = margin + random01() * (wall_top - 2 * margin);
+  } while (*x < 2.2f && *y < 2.2f);
+}
+
+/* Size that lets 'count' objects share the level, at most 'largest' */
+static float share (int count, float largest)
+{
+  return std::min(largest, 2.5f / std::sqrt((float) std::max(count, 1)));
+}
+
+bool stress_level (Level& level, int target_count, int obstacle_count, unsigned int seed)
+{
+  state = seed;
+  std::vector<Target> list(target_count);
+  std::vector<float> target_colors(3 * target_count);
+  float radius = share(target_count, .3f);
+  for (int t = 0; t < target_count; t++) {
+    Target& target = list[t];
+    target.radius = radius * (.5f + .5f * random01());
+    place(target.radius, &target.x, &target.y);
+    const float* color = palette[(int)(random01() * PALETTE_SIZE) % PALETTE_SIZE];
+    std::copy(color, color + 3, &target_colors[3 * t]);
+  }
+
+  // Turned squares, two triangles each
+  std::vector<Polygon> polygons(obstacle_count);
+  std::vector<float> vertices, colors;
+  vertices.reserve(18 * obstacle_count);
+  colors.reserve(18 * obstacle_count);
+  float side = share(obstacle_count, .4f);
+  for (int i = 0; i < obstacle_count; i++) {
+    float half = side * (.5f + .5f * random01()) / 2, angle = random01() * 1.5707963f;
+    float cx, cy;
+    place(half * 1.5f, &cx, &cy);
+    float c = half * std::cos(angle), s = half * std::sin(angle);
+    float corners[4][3] = { { cx - c + s, cy - s - c, 0 }, { cx + c + s, cy + s - c, 0 },
+                            { cx + c - s, cy + s + c, 0 }, { cx - c - s, cy - s + c, 0 } };
+    static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+    float grey = .3f + .4f * random01();
+    for (int k = 0; k < 6; k++) {
+      vertices.insert(vertices.end(), corners[order[k]], corners[order[k]] + 3);
+      colors.push_back(grey);
+      colors.push_back(grey);
+      colors.push_back(grey);
+    }
+    polygon_from_vertices(&vertices[vertices.size() - 18], 6, 0, 0, polygons[i]);
+  }
+
+  if (!level_build(level, list, target_colors, polygons, vertices, colors))
+    return false;
+  std::cerr << "stress: " << target_count << " targets, " << obstacle_count << " obstacles, seed " << seed << '\n';
+  return true;
+}
+
+void stress_balls (SimState& s, int count, unsigned int seed)
+{
+  state = seed ^ 0x9e3779b9u;
+  for (int i = 0; i < count; i++) {
+    float x, y;
+    place(BALL_RADIUS, &x, &y);
+    float angle = random01() * 6.2831853f, speed = 1 + 3 * random01();
+    projectiles_spawn(s.balls, x, y, speed * std::cos(angle), speed * std::sin(angle), INFINITY);
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include "level.h"
+#include "simulation.h"
+
+/* Scenes of any size for measuring how the game scales: targets,
+   obstacles and balls scattered over the level by a seeded generator, so
+   the same numbers give the same scene on every run. Objects shrink as
+   their number grows and may overlap, the corner of the cannon is kept
+   clear. */
+
+/* A level of 'targets' circles and 'obstacles' quads, held in memory */
+bool stress_level (Level& level, int targets, int obstacles, unsigned int seed);
+/* 'count' balls flying in random directions that stay in play for good,
+   the state needs room for them */
+void stress_balls (SimState& s, int count, unsigned int seed);
+
+#endif
@@ -0,0 +1,194 @@
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+struct TraceEvent {
+  const char* name;
+  long long ns;     // since the program started
+  char phase;       // 'B' or 'E'
+};
+
+/* Only its thread appends, and publishes every event through 'count'.
+   A buffer left from an earlier trace is emptied by its thread the first
+   time it traces again. */
+struct TraceBuffer {
+  int tid;
+  const char* name;
+  std::atomic<unsigned int> generation;
+  std::atomic<int> count;
+  std::atomic<int> dropped;
+  TraceEvent events[TRACE_EVENTS];
+};
+
+std::atomic<bool> trace_enabled(false);
+
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+static std::mutex buffers_mutex;
+static std::vector<TraceBuffer*> buffers;
+static std::atomic<unsigned int> generation(0);
+static thread_local TraceBuffer* buffer = NULL;
+static thread_local const char* thread_name = NULL;
+
+static std::string path = "trace.json";
+static volatile std::sig_atomic_t toggle_requested = 0;
+
+void trace_event (const char* name, char phase)
+{
+  TraceBuffer* b = buffer;
+  if (!b) {
+    b = buffer = new TraceBuffer;
+    b->name = thread_name;
+    b->generation = generation.load();
+    b->count = 0;
+    b->dropped = 0;
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    b->tid = buffers.size() + 1;
+    buffers.push_back(b);
+  }
+  unsigned int g = generation.load(std::memory_order_acquire);
+  if (b->generation.load(std::memory_order_relaxed) != g) {
+    b->count.store(0, std::memory_order_relaxed);
+    b->dropped = 0;
+    b->generation.store(g, std::memory_order_release);
+  }
+  int n = b->count.load(std::memory_order_relaxed);
+  if (n == TRACE_EVENTS) {
+    b->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  TraceEvent& e = b->events[n];
+  e.name = name;
+  e.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+  e.phase = phase;
+  b->count.store(n + 1, std::memory_order_release);
+}
+
+void trace_thread_name (const char* name)
+{
+  thread_name = name;
+  if (buffer)
+    buffer->name = name;
+}
+
+void trace_set_path (const char* p)
+{
+  path = p;
+}
+
+void trace_start ()
+{
+  if (trace_enabled)
+    return;
+  generation.fetch_add(1, std::memory_order_release);
+  trace_enabled = true;
+}
+
+/* Timestamps in microseconds, as the format has them */
+static void write_event (FILE* f, const char** separator, const char* name, char phase, long long ns, int tid)
+{
+  fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}", *separator, name, phase, ns / 1000.0, tid);
+  *separator = ",";
+}
+
+bool trace_stop ()
+{
+  if (!trace_enabled)
+    return true;
+  trace_enabled = false;
+
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) {
+    std::cerr << "trace: could not write " << path << '\n';
+    return false;
+  }
+  std::vector<TraceBuffer*> list;
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    list = buffers;
+  }
+  unsigned int g = generation.load();
+  const char* separator = "";
+  long events = 0, dropped = 0;
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (size_t i = 0; i < list.size(); i++) {
+    TraceBuffer* b = list[i];
+    if (b->generation.load(std::memory_order_acquire) != g)
+      continue;
+    // Events still coming in from a thread that has not seen the flag yet
+    // go past 'count' and are left out
+    int count = b->count.load(std::memory_order_acquire);
+    if (b->name) {
+      fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", separator, b->tid, b->name);
+      separator = ",";
+    }
+
+    // Spans cut by the start of the trace lose their end, spans cut by the
+    // stop get one at the last event of the thread
+    std::vector<const char*> open;
+    for (int k = 0; k < count; k++) {
+      const TraceEvent& e = b->events[k];
+      if (e.phase == 'E') {
+        if (open.empty())
+          continue;
+        open.pop_back();
+      }
+      else
+        open.push_back(e.name);
+      write_event(f, &separator, e.name, e.phase, e.ns, b->tid);
+      events++;
+    }
+    while (!open.empty()) {
+      write_event(f, &separator, open.back(), 'E', b->events[count - 1].ns, b->tid);
+      open.pop_back();
+    }
+    dropped += b->dropped.load(std::memory_order_relaxed);
+  }
+  fprintf(f, "\n]}\n");
+  bool ok = !ferror(f);
+  ok = fclose(f) == 0 && ok;
+  if (!ok) {
+    std::cerr << "trace: could not write " << path << '\n';
+    return false;
+  }
+  std::cerr << "trace: " << events << " events written to " << path;
+  if (dropped)
+    std::cerr << ", " << dropped << " dropped on full buffers";
+  std::cerr << '\n';
+  return true;
+}
+
+void trace_request_toggle ()
+{
+  toggle_requested = 1;
+}
+
+static void on_signal (int)
+{
+  trace_request_toggle();
+}
+
+void trace_install_signal ()
+{
+#ifdef SIGUSR1
+  std::signal(SIGUSR1, on_signal);
+#endif
+}
+
+void trace_poll ()
+{
+  if (!toggle_requested)
+    return;
+  toggle_requested = 0;
+  if (trace_enabled)
+    trace_stop();
+  else {
+    trace_start();
+    std::cerr << "trace: started\n";
+  }
+}
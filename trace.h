@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+
+/* Timeline of named spans on every thread, written as a trace.json that
+   chrome://tracing and Perfetto open. Each thread appends begin/end
+   events to a buffer of its own that no other thread writes, without
+   locks. While tracing is off a marker is a single load and branch on
+   trace_enabled. Tracing is toggled with F4 or SIGUSR1, and each stop
+   writes the file. */
+
+#define TRACE_EVENTS (1 << 16)   // per thread, later ones are dropped
+
+extern std::atomic<bool> trace_enabled;
+
+/* Appends to the calling thread's buffer, use the markers below */
+void trace_event (const char* name, char phase);
+
+/* 'name' must outlive the trace, a string literal */
+inline void trace_begin (const char* name)
+{
+  if (trace_enabled.load(std::memory_order_relaxed))
+    trace_event(name, 'B');
+}
+
+inline void trace_end (const char* name)
+{
+  if (trace_enabled.load(std::memory_order_relaxed))
+    trace_event(name, 'E');
+}
+
+struct TraceScope {
+  const char* name;
+  explicit TraceScope (const char* n) : name(n) { trace_begin(n); }
+  ~TraceScope () { trace_end(name); }
+};
+
+/* Label of the calling thread in the trace, a string literal */
+void trace_thread_name (const char* name);
+
+void trace_set_path (const char* path);
+void trace_start ();
+/* Stops and writes the file, false if it could not be */
+bool trace_stop ();
+
+/* F4 and SIGUSR1 only ask, safe inside a signal handler */
+void trace_request_toggle ();
+void trace_install_signal ();
+/* On the main thread once per frame, starts or stops when asked to */
+void trace_poll ();
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/* Latest value from one producer thread to one consumer thread, without
+   locks. The producer fills back() and publishes it, the consumer takes
+   the newest published value into front(); neither ever waits for the
+   other, values the consumer was too slow for are skipped. A value is
+   not touched again by the producer once published, so the consumer can
+   read its front for as long as it likes. */
+template <typename T>
+struct TripleBuffer {
+  T slots[3];
+  int back_slot, front_slot;        // owned by the producer and the consumer
+  std::atomic<int> middle;          // last published slot, plus FRESH until taken
+
+  enum { FRESH = 4 };
+
+  TripleBuffer () : back_slot(0), front_slot(1), middle(2) {}
+
+  T& back () { return slots[back_slot]; }
+  T& front () { return slots[front_slot]; }
+
+  void publish ()
+  {
+    back_slot = middle.exchange(back_slot | FRESH, std::memory_order_acq_rel) & ~FRESH;
+  }
+
+  /* False, with the front left as it was, when nothing was published
+     since the last take */
+  bool take ()
+  {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    front_slot = middle.exchange(front_slot, std::memory_order_acq_rel) & ~FRESH;
+    return true;
+  }
+
+  bool fresh () const
+  {
+    return middle.load(std::memory_order_acquire) & FRESH;
+  }
+};
+
+#endif